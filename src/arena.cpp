@@ -0,0 +1,61 @@
+#include <cassert>
+
+#include "arena.h"
+
+using namespace std;
+using namespace rvm;
+
+rvm::Arena::Arena(Arena&& other) :
+    _blocks(move(other._blocks)),
+    _position(other._position),
+    _remaining(other._remaining),
+    _allocated(other._allocated) {
+    other._position = nullptr;
+    other._remaining = 0;
+    other._allocated = 0;
+}
+
+Arena& rvm::Arena::operator=(Arena&& other) {
+    _blocks = move(other._blocks);
+    _position = other._position;
+    _remaining = other._remaining;
+    _allocated = other._allocated;
+    other._position = nullptr;
+    other._remaining = 0;
+    other._allocated = 0;
+    return *this;
+}
+
+void* rvm::Arena::allocate(size_t size, size_t alignment) {
+    assert((alignment & (alignment - 1)) == 0);
+    size_t padding = (alignment - reinterpret_cast<size_t>(_position) % alignment) % alignment;
+    if (padding + size > _remaining) {
+        // Large allocations get a block of their own, so the current block keeps its space.
+        if (size + alignment > blockSize / 4) {
+            _blocks.push_back(unique_ptr<char[]>(new char[size + alignment]));
+            char* block = _blocks.back().get();
+            _allocated += size;
+            return block + (alignment - reinterpret_cast<size_t>(block) % alignment) % alignment;
+        }
+        _blocks.push_back(unique_ptr<char[]>(new char[blockSize]));
+        _position = _blocks.back().get();
+        _remaining = blockSize;
+        padding = (alignment - reinterpret_cast<size_t>(_position) % alignment) % alignment;
+    }
+
+    char* result = _position + padding;
+    _position = result + size;
+    _remaining -= padding + size;
+    _allocated += size;
+    return result;
+}
+
+void rvm::Arena::take(Arena& other) {
+    // The current block stays current, other's blocks are only kept alive.
+    for (auto& block : other._blocks) _blocks.push_back(move(block));
+    _allocated += other._allocated;
+    other._blocks.clear();
+    other._position = nullptr;
+    other._remaining = 0;
+    other._allocated = 0;
+}
@@ -0,0 +1,49 @@
+#ifndef RVM_ARENA_H
+#define RVM_ARENA_H
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+namespace rvm {
+    /// A bump allocator over large blocks, everything it allocated is freed at once with the Arena.
+    /// Objects are not destroyed, so it is meant for trivially destructible data.
+    /// Blocks never move, so pointers stay valid when the Arena is moved or taken by another Arena.
+    class Arena {
+        std::vector<std::unique_ptr<char[]> > _blocks;
+        char* _position;
+        size_t _remaining;
+        size_t _allocated;
+
+    public:
+        static const size_t blockSize = 64 * 1024;
+
+        Arena() : _position(nullptr), _remaining(0), _allocated(0) {}
+        Arena(Arena&& other);
+        Arena& operator=(Arena&& other);
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        /// Returns size bytes aligned to alignment, which must be a power of two.
+        void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+        /// Constructs a T in the Arena, it is never destroyed so it must be trivially destructible.
+        template<typename T, typename... Args>
+        T* create(Args&&... args) {
+            static_assert(std::is_trivially_destructible<T>::value, "Arena objects are freed with the Arena and never destroyed");
+            return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        }
+
+        /// Keeps the blocks of other alive with this Arena, other is left empty.
+        void take(Arena& other);
+
+        /// The bytes handed out by allocate, without alignment padding and block slack.
+        size_t allocated() const { return _allocated; }
+        size_t blocks() const { return _blocks.size(); }
+    };
+};
+
+#endif
@@ -1,6 +1,8 @@
 #include "ast.h"
 
 using namespace std;
+using namespace rvm;
+using namespace rvm::ast;
 
 const string rvm::ast::UnaryOperatorString[8] {
     // Precedence 12
@@ -57,3 +59,81 @@ const string rvm::ast::BinaryOperatorString[29] {
     "/"s, // DivideOperator,
     "%"s, // ReminderOperator,
 };
+
+NodeId rvm::ast::Tree::add(Kind kind, unsigned char op, unsigned int token, initializer_list<NodeId> children, const NodeId* list, size_t count) {
+    NodeId node = NodeId(_nodes.size());
+    unsigned int first = (unsigned int)_children.size();
+    _children.insert(_children.end(), children.begin(), children.end());
+    _children.insert(_children.end(), list, list + count);
+    _nodes.push_back({ kind, op, token, first, (unsigned int)(children.size() + count) });
+    bind();
+    return node;
+}
+
+size_t rvm::ast::Tree::bytes() const {
+    return _nodes.capacity() * sizeof(Node) + _children.capacity() * sizeof(NodeId) + _types.capacity() * sizeof(type::Type*);
+}
+
+NodeId rvm::ast::Tree::append(const Tree& other, NodeId begin, NodeId end) {
+    NodeId offset = NodeId(_nodes.size());
+    _nodes.reserve(_nodes.size() + (end - begin));
+    for (NodeId id = begin; id < end; id++) {
+        Node node = other._nodes[id];
+        unsigned int first = (unsigned int)_children.size();
+        for (unsigned int slot = node.first; slot < node.first + node.count; slot++) {
+            NodeId child = other._children[slot];
+            _children.push_back(child == noNode ? noNode : child - begin + offset);
+        }
+        node.first = first;
+        _nodes.push_back(node);
+    }
+    bind();
+    return offset;
+}
+
+void rvm::ast::Tree::moveTokens(unsigned int first, long long shift) {
+    for (Node& node : _nodes) {
+        if (node.token != noToken && node.token >= first) node.token = (unsigned int)(node.token + shift);
+        if (node.kind != Kind::Function || node.op != deferredBody) continue;
+        for (unsigned int slot = node.first + 2; slot < node.first + 4; slot++) {
+            if (_children[slot] >= first) _children[slot] = NodeId(_children[slot] + shift);
+        }
+    }
+    bind();
+}
+
+Atom rvm::ast::Tree::name(NodeId node) const {
+    unsigned int token = _nodeData[node].token;
+    if (token == noToken) return Atom();
+    return _tokens->token(token).value<Atom>();
+}
+
+Token rvm::ast::Tree::token(NodeId node) const {
+    unsigned int token = _nodeData[node].token;
+    if (token == noToken) return Token();
+    return _tokens->token(token);
+}
+
+SourceSpan rvm::ast::Tree::span(NodeId node) const {
+    unsigned int token = _nodeData[node].token;
+    if (token == noToken) return SourceSpan();
+    return _tokens->span(token);
+}
+
+unsigned short rvm::ast::Tree::precedence(NodeId node) const {
+    static const unsigned short binaryPrecedence[29] {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // Assignments
+        2, 3, 4, 5, 6, // || && | ^ &
+        7, 7, // == !=
+        8, 8, 8, 8, // < > <= >=
+        9, 9, // << >>
+        10, 10, // + -
+        11, 11, 11, // * / %
+    };
+    switch (_nodeData[node].kind) {
+        case Kind::Binary: return binaryPrecedence[_nodeData[node].op];
+        case Kind::Unary: return _nodeData[node].op >= PostIncrementOperator ? 13 : 12;
+        case Kind::ConditionalIf: return 1;
+        default: return 13;
+    }
+}
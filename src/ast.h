@@ -3,43 +3,49 @@
 
 #include <string>
 #include <vector>
+#include <initializer_list>
 #include "lexer.h"
+#include "tokenbuffer.h"
 #include "types.h"
 
 namespace rvm {
+    class Parser;
+    class ASTCache;
+
     namespace ast {
         typedef typename rvm::Lexer::Token Token;
 
-        class Expression;
-
-        class ModuleMember;
-
-        class Function;
-        class FunctionDeclaration;
-        class FunctionPrototype;
-        class FunctionArgument;
-
-        class Statement;
-        class CodeBlock;
-        class ConstStatement;
-        class ReturnStatement;
-
-        class ValueExpression;
-        class IdentifierExpression;
-        class ConstantValueExpression;
-        class MemberAccessExpression;
-        class InvocationExpression;
-        class ConditionalIfExpression;
-
-        class UnaryExpression;
-        class BinaryExpression;
-
-        class TypeExpression;
-        class PrimitiveTypeExpression;
-
-        typedef std::unique_ptr<Statement> ptr_statement;
-        typedef std::unique_ptr<TypeExpression> ptr_typeExp;
-        typedef std::unique_ptr<ValueExpression> ptr_value;
+        /// Nodes are addressed by their index in the Tree of their module.
+        typedef unsigned int NodeId;
+        const NodeId noNode = 0xFFFFFFFF;
+
+        /// The token of a node that the parser recovered without, its name is the empty Atom.
+        const unsigned int noToken = 0xFFFFFFFF;
+
+        enum class Kind : unsigned char {
+            // Module members
+            Function,
+            FunctionDeclaration,
+            FunctionPrototype,
+            FunctionArgument,
+
+            // Type expressions
+            PrimitiveType,
+
+            // Statements
+            CodeBlock,
+            ConstStatement,
+            ReturnStatement,
+
+            // Value expressions
+            Identifier,
+            ConstantValue,
+            MemberAccess,
+            Invocation,
+            ConditionalIf,
+            Unary,
+            Binary,
+        };
 
         enum UnaryOperator {
             // Precedence 12
@@ -56,8 +62,6 @@ namespace rvm {
         };
         extern const std::string UnaryOperatorString[8];
 
-        class UnaryExpression;
-
         enum BinaryOperator {
             AssignmentOperator,
             AdditionAssignmentOperator,
@@ -105,106 +109,6 @@ namespace rvm {
         inline const std::string toString(UnaryOperator op) { return UnaryOperatorString[op]; }
         inline const std::string toString(BinaryOperator op) { return BinaryOperatorString[op]; }
 
-        class ModuleMemberVisitor {
-        public:
-            virtual void on(Function* f) = 0;
-            virtual void on(FunctionDeclaration* f) = 0;
-        };
-
-        class TypeExpressionVisitor {
-        public:
-            virtual void on(PrimitiveTypeExpression* t) = 0;
-        };
-
-        class StatementVisitor {
-        public:
-            virtual void on(CodeBlock* block) {}
-            virtual void on(ConstStatement* block) {}
-            virtual void on(ReturnStatement* block) {}
-
-            virtual void on(IdentifierExpression* expression) {}
-            virtual void on(ConstantValueExpression* expression) {}
-            virtual void on(MemberAccessExpression* expression) {}
-            virtual void on(InvocationExpression* expression) {}
-            virtual void on(ConditionalIfExpression* expression) {}
-
-            virtual void on(UnaryExpression* expression) {}
-            virtual void on(BinaryExpression* expression) {}
-        };
-
-        class ModuleMember {
-        public:
-            virtual void visit(ModuleMemberVisitor* visitor) = 0;
-            virtual ~ModuleMember() {}
-        };
-
-        class Typed {
-            rvm::type::Type* _type;
-        public:
-            Typed() : _type(nullptr) {}
-            rvm::type::Type* type() { return _type; }
-            void setType(rvm::type::Type* type) { _type = type; }
-        };
-
-        class FunctionPrototype : public Typed {
-            std::vector<std::unique_ptr<FunctionArgument> > _args;
-            ptr_typeExp _returnTypeAnnotation;
-        public:
-            FunctionPrototype(std::vector<std::unique_ptr<FunctionArgument> > args, ptr_typeExp returnTypeAnnotation) :
-                _args(std::move(args)),
-                _returnTypeAnnotation(std::move(returnTypeAnnotation)) {}
-            
-            std::vector<std::unique_ptr<FunctionArgument> >& args() { return _args; }
-            ptr_typeExp& returnTypeAnnotation() { return _returnTypeAnnotation; }
-        };
-
-        class Function : public ModuleMember {
-            Token _identifier;
-            std::unique_ptr<FunctionPrototype> _proto;
-            std::unique_ptr<CodeBlock> _block;
-        public:
-            Function(Token identifier, std::unique_ptr<FunctionPrototype> proto, std::unique_ptr<CodeBlock> block) :
-                _identifier(identifier),
-                _proto(move(proto)),
-                _block(move(block)) {}
-
-            std::string name() { return _identifier.value<std::string>(); }
-            std::unique_ptr<FunctionPrototype>& proto() { return _proto; }
-            std::unique_ptr<CodeBlock>& codeBlock() { return _block; }
-
-            void visit(ModuleMemberVisitor* visitor) override { visitor->on(this); }
-        };
-
-        class FunctionDeclaration : public ModuleMember {
-            Token _identifier;
-            std::unique_ptr<FunctionPrototype> _proto;
-        public:
-            FunctionDeclaration(Token identifier, std::unique_ptr<FunctionPrototype> proto) :
-                _identifier(identifier),
-                _proto(std::move(proto)) {}
-
-            std::string name() { return _identifier.value<std::string>(); }
-            std::unique_ptr<FunctionPrototype>& proto() { return _proto; }
-
-            void visit(ModuleMemberVisitor* visitor) override { visitor->on(this); }
-        };
-
-        class FunctionArgument : public Typed {
-            Token _identifier;
-            ptr_typeExp _type;
-        public:
-            FunctionArgument(Token identifier, ptr_typeExp type) : _identifier(identifier), _type(move(type)) {}
-            std::string name() { return _identifier.value<std::string>(); }
-            ptr_typeExp& typeAnnotation() { return _type; }
-        };
-
-        class TypeExpression : public Typed {
-        public:
-            TypeExpression() {}
-            virtual void visit(TypeExpressionVisitor* visitor) = 0;
-            virtual ~TypeExpression() {}
-        };
-
         enum PrimitiveType {
             Int,
             Float,
@@ -212,222 +116,257 @@ namespace rvm {
             Bool,
         };
 
-        class PrimitiveTypeExpression : public TypeExpression {
-            Token _keyword;
-            PrimitiveType _type;
-        public:
-            PrimitiveTypeExpression(Token keyword, PrimitiveType type) : _keyword(keyword), _type(type) {}
-            PrimitiveType type() { return _type; }
-            void visit(TypeExpressionVisitor* visitor) override {
-                visitor->on(this);
-            }
+        /// A node is 16 bytes, what it holds depends on its kind.
+        /// token is the name, keyword, literal or operator token of the node, op is the UnaryOperator,
+        /// BinaryOperator or PrimitiveType. The children are the node ids in [first, first + count)
+        /// of the Tree's children array, optional children are noNode:
+        ///   Function: prototype, code block
+        ///   FunctionDeclaration: prototype
+        ///   FunctionPrototype: return type annotation, arguments...
+        ///   FunctionArgument: type annotation
+        ///   CodeBlock: statements...
+        ///   ConstStatement: type annotation, value
+        ///   ReturnStatement: value
+        ///   MemberAccess: operand
+        ///   Invocation: operand, values...
+        ///   ConditionalIf: condition, then, else
+        ///   Unary: operand
+        ///   Binary: lhs, rhs
+        struct Node {
+            Kind kind;
+            unsigned char op;
+            unsigned int token;
+            unsigned int first;
+            unsigned int count;
         };
 
-        class Statement {
-        public:
-            virtual ~Statement() {}
-            virtual void visit(StatementVisitor* visitor) = 0;
-        };
+        /// A range of child node ids, read by index so it stays valid while the Tree grows.
+        class Children {
+            const NodeId* const* _ids;
+            unsigned int _begin, _end;
 
-        class CodeBlock : public Statement {
-            std::vector<ptr_statement> _statements;
         public:
-            CodeBlock(std::vector<ptr_statement> statements) : _statements(std::move(statements)) {}
-            std::vector<ptr_statement>& statements() { return _statements; }
-            void visit(StatementVisitor* visitor) override { visitor->on(this); }
+            class Iterator {
+                const NodeId* const* _ids;
+                unsigned int _index;
+            public:
+                Iterator(const NodeId* const* ids, unsigned int index) : _ids(ids), _index(index) {}
+                NodeId operator*() const { return (*_ids)[_index]; }
+                Iterator& operator++() { ++_index; return *this; }
+                bool operator!=(const Iterator& other) const { return _index != other._index; }
+            };
+
+            Children(const NodeId* const* ids, unsigned int begin, unsigned int end) : _ids(ids), _begin(begin), _end(end) {}
+
+            Iterator begin() const { return Iterator(_ids, _begin); }
+            Iterator end() const { return Iterator(_ids, _end); }
+            size_t size() const { return _end - _begin; }
+            bool empty() const { return _begin == _end; }
+            NodeId operator[](size_t index) const { return (*_ids)[_begin + index]; }
         };
 
-        class ConstStatement : public Statement {
-            Token _identifier;
-            ptr_typeExp _typeAnnotation;
-            ptr_value _value;
-        public:
-            ConstStatement(Token identifier, ptr_typeExp typeAnnotation, ptr_value value) :
-                _identifier(identifier),
-                _typeAnnotation(move(typeAnnotation)),
-                _value(move(value)) {}
-
-            std::string name() { return _identifier.value<std::string>(); }
-            ptr_typeExp& typeAnnotation() { return _typeAnnotation; }
-            ptr_value& value() { return _value; }
-            void visit(StatementVisitor* visitor) override { visitor->on(this); }
-        };
+        /// The nodes of a module in one array, linked to their children by index.
+        /// Passes walk it with a switch on the node kind, see Visitor, and the resolved
+        /// type of every node is kept in an array beside the nodes.
+        /// Nothing in the arrays depends on where they are in memory, so the ASTCache
+        /// maps them from a file and a loaded Tree reads them there.
+        class Tree {
+            const rvm::TokenBuffer* _tokens;
+            rvm::Parser* _parser;
+            std::vector<Node> _nodes;
+            std::vector<NodeId> _children;
+            // Allocated by the first setType.
+            std::vector<rvm::type::Type*> _types;
+
+            // The nodes and children are read through these, they point into the vectors above or into a mapped file.
+            const Node* _nodeData;
+            const NodeId* _childData;
+            size_t _size;
+
+            friend class rvm::Parser;
+            friend class rvm::ASTCache;
+
+            void bind() {
+                _nodeData = _nodes.data();
+                _childData = _children.data();
+                _size = _nodes.size();
+            }
 
-        class ReturnStatement : public Statement {
-            ptr_value _value;
-        public:
-            ReturnStatement(ptr_value value) : _value(move(value)) {}
-            ptr_value& value() { return _value; }
-            void visit(StatementVisitor* visitor) override { visitor->on(this); }
-        };
+            // A deferred function has op set, and the token range of its body after its two children.
+            static const unsigned char deferredBody = 1;
+            size_t bodyStart(NodeId function) const { return _childData[_nodeData[function].first + 2]; }
+            size_t bodyEnd(NodeId function) const { return _childData[_nodeData[function].first + 3]; }
+            void setCodeBlock(NodeId function, NodeId block) {
+                _children[_nodes[function].first + 1] = block;
+                _nodes[function].op = 0;
+            }
 
-        class ValueExpression : public Statement, public Typed {
-        public:
-            ValueExpression() {}
-            virtual unsigned short precedence() = 0;
-        };
+            // Appends the nodes from begin to end of other, whose children are among them, and returns the id of the first.
+            // The children slots past a node's count, the body range of a deferred function, are not copied.
+            NodeId append(const Tree& other, NodeId begin, NodeId end);
 
-        class UnaryExpression : public ValueExpression {
-            ptr_value _operand;
-            Token _token;
-        public:
-            UnaryExpression(ptr_value operand, Token token) : _token(token), _operand(move(operand)) {}
-            UnaryExpression(Token token, ptr_value operand) : _operand(move(operand)), _token(token) {}
-            virtual UnaryOperator op() = 0;
-            ptr_value& operand() { return _operand; }
-            SourceSpan span() { return _token.span(); }
-        };
+            // Adds shift to the token indices from first on, and to the body ranges of deferred functions,
+            // after the tokens before first were replaced by shift more or fewer.
+            void moveTokens(unsigned int first, long long shift);
 
-        class BinaryExpression : public ValueExpression {
-            ptr_value _lhs, _rhs;
-            Token _token;
         public:
-            BinaryExpression(ptr_value lhs, Token token, ptr_value rhs) :
-                _lhs(move(lhs)),
-                _token(token),
-                _rhs(move(rhs)) {}
-            virtual BinaryOperator op() = 0;
-            ptr_value& lhs() { return _lhs; }
-            ptr_value& rhs() { return _rhs; }
-            SourceSpan span() { return _token.span(); }
+            /// Names and literals are read from tokens, parser parses the deferred function bodies.
+            Tree(const rvm::TokenBuffer* tokens, rvm::Parser* parser) :
+                _tokens(tokens),
+                _parser(parser),
+                _nodeData(nullptr),
+                _childData(nullptr),
+                _size(0) {}
+
+            Tree(Tree&&) = default;
+            Tree& operator=(Tree&&) = default;
+            Tree(const Tree&) = delete;
+            Tree& operator=(const Tree&) = delete;
+
+            /// Adds a node with the fixed children, followed by count children from list.
+            NodeId add(Kind kind, unsigned char op, unsigned int token, std::initializer_list<NodeId> children, const NodeId* list = nullptr, size_t count = 0);
+
+            size_t size() const { return _size; }
+
+            /// The bytes held by the node, children and type arrays.
+            size_t bytes() const;
+
+            Kind kind(NodeId node) const { return _nodeData[node].kind; }
+            Children children(NodeId node) const { return Children(&_childData, _nodeData[node].first, _nodeData[node].first + _nodeData[node].count); }
+            NodeId child(NodeId node, size_t index) const { return _childData[_nodeData[node].first + index]; }
+
+            Atom name(NodeId node) const;
+            Token token(NodeId node) const;
+            SourceSpan span(NodeId node) const;
+            unsigned short precedence(NodeId node) const;
+
+            rvm::type::Type* type(NodeId node) const { return node < _types.size() ? _types[node] : nullptr; }
+            void setType(NodeId node, rvm::type::Type* type) {
+                if (_types.size() < _size) _types.resize(_size, nullptr);
+                _types[node] = type;
+            }
+
+            /// Allocates the types of all nodes, after which passes on several threads may set the types of different nodes.
+            void allocateTypes() { if (_types.size() < _size) _types.resize(_size, nullptr); }
+
+            UnaryOperator unaryOperator(NodeId node) const { return UnaryOperator(_nodeData[node].op); }
+            BinaryOperator binaryOperator(NodeId node) const { return BinaryOperator(_nodeData[node].op); }
+            PrimitiveType primitiveType(NodeId node) const { return PrimitiveType(_nodeData[node].op); }
+
+            NodeId proto(NodeId function) const { return child(function, 0); }
+
+            /// The body of a function, a deferred body is parsed on the first call.
+            /// noNode when a deferred body failed to parse with a DiagnosticEngine, the errors are reported there.
+            NodeId codeBlock(NodeId function);
+            bool isBodyParsed(NodeId function) const { return _nodeData[function].op != deferredBody; }
+
+            NodeId returnTypeAnnotation(NodeId proto) const { return child(proto, 0); }
+            Children args(NodeId proto) const { return Children(&_childData, _nodeData[proto].first + 1, _nodeData[proto].first + _nodeData[proto].count); }
+            NodeId typeAnnotation(NodeId node) const { return child(node, 0); }
+            Children statements(NodeId block) const { return children(block); }
+            NodeId value(NodeId statement) const { return child(statement, _nodeData[statement].kind == Kind::ConstStatement ? 1 : 0); }
+            NodeId operand(NodeId expression) const { return child(expression, 0); }
+            Children values(NodeId invocation) const { return Children(&_childData, _nodeData[invocation].first + 1, _nodeData[invocation].first + _nodeData[invocation].count); }
+            NodeId ifExpression(NodeId conditional) const { return child(conditional, 0); }
+            NodeId thenExpression(NodeId conditional) const { return child(conditional, 1); }
+            NodeId elseExpression(NodeId conditional) const { return child(conditional, 2); }
+            NodeId lhs(NodeId binary) const { return child(binary, 0); }
+            NodeId rhs(NodeId binary) const { return child(binary, 1); }
         };
 
-        #define UNARY_EXPRESSION_CLASS(CLASS, OPERATOR, PRECEDENCE)\
-        class CLASS : public UnaryExpression {\
-        public:\
-            CLASS(ptr_value operand, Token token) : UnaryExpression(move(operand), token) {}\
-            CLASS(Token token, ptr_value operand) : UnaryExpression(token, move(operand)) {}\
-            unsigned short precedence() override { return PRECEDENCE; }\
-            UnaryOperator op() override { return OPERATOR; }\
-            void visit(StatementVisitor* visitor) override { visitor->on(this); }\
-        };\
-
-        #define BINARY_EXPRESSION_CLASS(CLASS, OPERATOR, PRECEDENCE)\
-        class CLASS : public BinaryExpression {\
-        public:\
-            CLASS(ptr_value lhs, Token token, ptr_value rhs) : BinaryExpression(move(lhs), token, move(rhs)) {}\
-            unsigned short precedence() override { return PRECEDENCE; }\
-            BinaryOperator op() override { return OPERATOR; }\
-            void visit(StatementVisitor* visitor) override { visitor->on(this); }\
-        };\
-
-        // Precedence 0
-        BINARY_EXPRESSION_CLASS(AssignmentExpression, AssignmentOperator, 0)
-        BINARY_EXPRESSION_CLASS(AdditionAssignmentExpression, AdditionAssignmentOperator, 0)
-        BINARY_EXPRESSION_CLASS(SubtractionAssignmentExpression, SubtractionAssignmentOperator, 0)
-        BINARY_EXPRESSION_CLASS(MultiplicationAssignmentExpression, MultiplicationAssignmentOperator, 0)
-        BINARY_EXPRESSION_CLASS(DivisionAssignmentExpression, DivisionAssignmentOperator, 0)
-        BINARY_EXPRESSION_CLASS(BitAndAssignmentExpression, BitAndAssignmentOperator, 0)
-        BINARY_EXPRESSION_CLASS(BitXOrAssignmentExpression, BitXOrAssignmentOperator, 0)
-        BINARY_EXPRESSION_CLASS(BitOrAssignmentExpression, BitOrAssignmentOperator, 0)
-        BINARY_EXPRESSION_CLASS(ReminderAssignmentExpression, ReminderAssignmentOperator, 0)
-        BINARY_EXPRESSION_CLASS(LeftShiftAssignmentExpression, LeftShiftAssignmentOperator, 0)
-        BINARY_EXPRESSION_CLASS(RightShiftAssignmentExpression, RightShiftAssignmentOperator, 0)
-
-        // Precedence 1
-        class ConditionalIfExpression : public ValueExpression {
-            ptr_value _ifExp, _thenExp, _elseExp;
+        /// A static visitor: visit switches on the node kind and calls the on method of Derived for it.
+        /// The on methods here do nothing, Derived hides the ones it handles.
+        /// Visiting children from on methods recurses once per level, walk does not and is used for expressions.
+        template<typename Derived>
+        class Visitor {
+            struct WalkFrame {
+                NodeId node;
+                unsigned int next;
+            };
+            std::vector<WalkFrame> _walk;
+
+        protected:
+            Tree* _tree;
+
         public:
-            ConditionalIfExpression(ptr_value ifExp, ptr_value thenExp, ptr_value elseExp) :
-                _ifExp(move(ifExp)),
-                _thenExp(move(thenExp)),
-                _elseExp(move(elseExp)) {}
+            Visitor() : _tree(nullptr) {}
+
+            /// Visits node of tree, then nodes are visited in tree again.
+            void visit(Tree& tree, NodeId node) {
+                Tree* outer = _tree;
+                _tree = &tree;
+                visit(node);
+                _tree = outer;
+            }
 
-            ptr_value& ifExpression() { return _ifExp; }
-            ptr_value& thenExpression() { return _thenExp; }
-            ptr_value& elseExpression() { return _elseExp; }
+            void visit(NodeId node) {
+                Derived* derived = static_cast<Derived*>(this);
+                switch (_tree->kind(node)) {
+                    case Kind::Function: derived->onFunction(node); break;
+                    case Kind::FunctionDeclaration: derived->onFunctionDeclaration(node); break;
+                    case Kind::FunctionPrototype: derived->onFunctionPrototype(node); break;
+                    case Kind::FunctionArgument: derived->onFunctionArgument(node); break;
+                    case Kind::PrimitiveType: derived->onPrimitiveType(node); break;
+                    case Kind::CodeBlock: derived->onCodeBlock(node); break;
+                    case Kind::ConstStatement: derived->onConstStatement(node); break;
+                    case Kind::ReturnStatement: derived->onReturnStatement(node); break;
+                    case Kind::Identifier: derived->onIdentifier(node); break;
+                    case Kind::ConstantValue: derived->onConstantValue(node); break;
+                    case Kind::MemberAccess: derived->onMemberAccess(node); break;
+                    case Kind::Invocation: derived->onInvocation(node); break;
+                    case Kind::ConditionalIf: derived->onConditionalIf(node); break;
+                    case Kind::Unary: derived->onUnary(node); break;
+                    case Kind::Binary: derived->onBinary(node); break;
+                }
+            }
 
-            unsigned short precedence() override { return 1; }
-            void visit(StatementVisitor* visitor) override { visitor->on(this); }
-        };
+            /// Walks the subtree of node with an explicit stack, so expressions may nest deeper than the call stack allows.
+            /// Derived::enter(node) runs first and returns whether to walk the children of node, then Derived::between(node, index)
+            /// runs before each child after the first and Derived::leave(node) after the last. Children that are noNode are skipped.
+            /// A pass checks operands in leave, or prints operators in between, and visits the nodes it does not walk into.
+            void walk(NodeId node) {
+                Derived* derived = static_cast<Derived*>(this);
+                if (!derived->enter(node)) return;
+                // Handlers may walk other subtrees, they push above base and pop back to it.
+                size_t base = _walk.size();
+                _walk.push_back({ node, 0 });
+                while (_walk.size() > base) {
+                    WalkFrame& frame = _walk.back();
+                    NodeId parent = frame.node;
+                    size_t count = _tree->children(parent).size();
+                    NodeId child = noNode;
+                    while (frame.next < count && (child = _tree->child(parent, frame.next)) == noNode) frame.next++;
+                    if (frame.next == count) {
+                        _walk.pop_back();
+                        derived->leave(parent);
+                        continue;
+                    }
+                    size_t index = frame.next++;
+                    if (index > 0) derived->between(parent, index);
+                    if (derived->enter(child)) _walk.push_back({ child, 0 });
+                }
+            }
 
-        // Precedence 2
-        BINARY_EXPRESSION_CLASS(ConditionalOrExpression, ConditionalOrOperator, 2)
-
-        // Precedence 3
-        BINARY_EXPRESSION_CLASS(ConditionalAndExpression, ConditionalAndOperator, 3)
-
-        // Precedence 4
-        BINARY_EXPRESSION_CLASS(BitwiseOrExpression, BitwiseOrOperator, 4)
-
-        // Precedence 5
-        BINARY_EXPRESSION_CLASS(BitwiseXOrExpression, BitwiseXOrOperator, 5)
-
-        // Precedence 6
-        BINARY_EXPRESSION_CLASS(BitwiseAndExpression, BitwiseAndOperator, 6)
-
-        // Precedence 7
-        BINARY_EXPRESSION_CLASS(EqualExpression, EqualOperator, 7)
-        BINARY_EXPRESSION_CLASS(NotEqualExpression, NotEqualOperator, 7)
-
-        // Precedence 8
-        BINARY_EXPRESSION_CLASS(LessThanExpression, LessThanOperator, 8)
-        BINARY_EXPRESSION_CLASS(GreaterThanExpression, GreaterThanOperator, 8)
-        BINARY_EXPRESSION_CLASS(LessOrEqualExpression, LessOrEqualOperator, 8)
-        BINARY_EXPRESSION_CLASS(GreaterOrEqualExpression, GreaterOrEqualOperator, 8)
-
-        // Precedence 9
-        BINARY_EXPRESSION_CLASS(LeftShiftExpression, LeftShiftOperator, 9)
-        BINARY_EXPRESSION_CLASS(RightShiftExpression, RightShiftOperator, 9)
-        
-        // Precedence 10
-        BINARY_EXPRESSION_CLASS(AddExpression, AddOperator, 10)
-        BINARY_EXPRESSION_CLASS(SubtractExpression, SubtractOperator, 10)
-
-        // Precedence 11
-        BINARY_EXPRESSION_CLASS(MultiplyExpression, MultiplyOperator, 11)
-        BINARY_EXPRESSION_CLASS(DivideExpression, DivideOperator, 11)
-        BINARY_EXPRESSION_CLASS(ReminderExpression, ReminderOperator, 11)
-
-        // Precedence 12
-        UNARY_EXPRESSION_CLASS(ConditionalNotExpression, ConditionalNotOperator, 12);
-        UNARY_EXPRESSION_CLASS(UnaryPlusExpression, UnaryPlusOperator, 12);
-        UNARY_EXPRESSION_CLASS(UnaryMinusExpression, UnaryMinusOperator, 12);
-        UNARY_EXPRESSION_CLASS(PreIncrementExpression, PreIncrementOperator, 12);
-        UNARY_EXPRESSION_CLASS(PreDecrementExpression, PreDecrementOperator, 12);
-        UNARY_EXPRESSION_CLASS(BitComplementExpression, BitComplementOperator, 12);
-
-        // Precedence 13 Expressions
-        class IdentifierExpression : public ValueExpression {
-            Token _identifier;
-        public:
-            IdentifierExpression(Token identifier) : _identifier(identifier) {}
-            std::string name() { return _identifier.value<std::string>(); }
-            unsigned short precedence() override { return 13; }
-            void visit(StatementVisitor* visitor) override { visitor->on(this); }
-            SourceSpan span() { return _identifier.span(); } 
+            bool enter(NodeId node) { return true; }
+            void between(NodeId node, size_t index) {}
+            void leave(NodeId node) {}
+
+            void onFunction(NodeId node) {}
+            void onFunctionDeclaration(NodeId node) {}
+            void onFunctionPrototype(NodeId node) {}
+            void onFunctionArgument(NodeId node) {}
+            void onPrimitiveType(NodeId node) {}
+            void onCodeBlock(NodeId node) {}
+            void onConstStatement(NodeId node) {}
+            void onReturnStatement(NodeId node) {}
+            void onIdentifier(NodeId node) {}
+            void onConstantValue(NodeId node) {}
+            void onMemberAccess(NodeId node) {}
+            void onInvocation(NodeId node) {}
+            void onConditionalIf(NodeId node) {}
+            void onUnary(NodeId node) {}
+            void onBinary(NodeId node) {}
         };
-        class ConstantValueExpression : public ValueExpression {
-            Token _literal;
-        public:
-            ConstantValueExpression(Token literal) : _literal(literal) {}
-            unsigned short precedence() override { return 13; }
-            Token literal() { return _literal; }
-            void visit(StatementVisitor* visitor) override { visitor->on(this); }
-        };
-        class MemberAccessExpression : public ValueExpression {
-            Token _name;
-            ptr_value _operand;
-        public:
-            MemberAccessExpression(ptr_value operand, Token name) : _operand(move(operand)), _name(name) {}
-            ptr_value& operand() { return _operand; }
-            std::string name() { return _name.value<std::string>(); }
-            unsigned short precedence() override { return 13; }
-            void visit(StatementVisitor* visitor) override { visitor->on(this); }
-        };
-        class InvocationExpression : public ValueExpression {
-            std::vector<ptr_value> _values;
-            ptr_value _operand;
-        public:
-            InvocationExpression(ptr_value lhs, std::vector<ptr_value> values) : _operand(move(lhs)), _values(move(values)) {}
-            ptr_value& operand() { return _operand; }
-            unsigned short precedence() override { return 13; }
-            std::vector<ptr_value>& values() { return _values; }
-            void visit(StatementVisitor* visitor) override { visitor->on(this); }
-        };
-
-        UNARY_EXPRESSION_CLASS(PostIncrementExpression, PostIncrementOperator, 13);
-        UNARY_EXPRESSION_CLASS(PostDecrementExpression, PostDecrementOperator, 13);
     };
 };
 
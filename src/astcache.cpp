@@ -0,0 +1,338 @@
+#include <cerrno>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <system_error>
+#include <unordered_map>
+#include <filesystem>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "astcache.h"
+#include "parser.h"
+
+using namespace std;
+using namespace rvm;
+using namespace rvm::ast;
+
+namespace {
+    // Sections of a cache file, in file order.
+    enum Section {
+        Kinds,
+        Offsets,
+        Lengths,
+        ValueIndices,
+        Integers,
+        Floats,
+        // Slices of StringBytes.
+        Strings,
+        StringBytes,
+        // Slices of AtomBytes, the value index of an identifier is its index here.
+        Atoms,
+        AtomBytes,
+        Nodes,
+        NodeChildren,
+        Members,
+        SectionCount,
+    };
+
+    const size_t elementSize[SectionCount] {
+        sizeof(TokenType),
+        sizeof(unsigned int),
+        sizeof(unsigned int),
+        sizeof(unsigned int),
+        sizeof(unsigned long long),
+        sizeof(double),
+        2 * sizeof(unsigned int),
+        1,
+        2 * sizeof(unsigned int),
+        1,
+        sizeof(Node),
+        sizeof(NodeId),
+        sizeof(NodeId),
+    };
+
+    struct Slice {
+        unsigned int offset;
+        unsigned int length;
+    };
+
+    struct Header {
+        char magic[4];
+        unsigned int version;
+        // byteOrderMark as written, files from a machine of the other byte order do not match.
+        unsigned int byteOrder;
+        unsigned int nodeSize;
+        unsigned long long sourceHash;
+        unsigned long long sourceSize;
+        // Byte offset and element count of each section, offsets are aligned to 8 bytes.
+        unsigned long long offsets[SectionCount];
+        unsigned long long counts[SectionCount];
+    };
+
+    const char magic[4] { 'R', 'A', 'S', 'T' };
+    const unsigned int byteOrderMark = 0x01020304;
+
+    size_t align(size_t offset) { return (offset + 7) / 8 * 8; }
+
+    inline unsigned long long rotate(unsigned long long value, int bits) { return (value << bits) | (value >> (64 - bits)); }
+
+    inline unsigned long long load64(const char* data) {
+        unsigned long long value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    // The data of one section to write, with the element count.
+    struct Output {
+        const void* data;
+        size_t count;
+    };
+}
+
+rvm::CachedModule::CachedModule(unique_ptr<TokenBuffer> tokens) :
+    _data(nullptr),
+    _size(0),
+    _tokens(move(tokens)),
+    _tree(_tokens.get(), nullptr) {}
+
+rvm::CachedModule::~CachedModule() {
+#if !defined(_WIN32)
+    if (_data != nullptr && _owned.empty()) munmap(const_cast<char*>(_data), _size);
+#endif
+}
+
+rvm::ASTCache::ASTCache(string directory) : _directory(move(directory)) {
+    error_code error;
+    filesystem::create_directories(_directory, error);
+    if (error) throw system_error(error, _directory);
+}
+
+// Four independent multiply-rotate lanes over 8 byte words, so hashing runs at memory speed
+// and costs little next to an mmap. It keys a cache, it is not meant to resist collisions on purpose.
+unsigned long long rvm::ASTCache::hash(string_view code) {
+    const unsigned long long prime1 = 0x9E3779B185EBCA87ULL;
+    const unsigned long long prime2 = 0xC2B2AE3D27D4EB4FULL;
+    unsigned long long lanes[4] { prime1 + prime2, prime2, 0, 0 - prime1 };
+
+    const char* data = code.data();
+    size_t size = code.size();
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        for (int lane = 0; lane < 4; lane++) {
+            lanes[lane] = rotate(lanes[lane] + load64(data + i + lane * 8) * prime2, 31) * prime1;
+        }
+    }
+
+    unsigned long long result = rotate(lanes[0], 1) + rotate(lanes[1], 7) + rotate(lanes[2], 12) + rotate(lanes[3], 18) + size;
+    for (; i < size; i += 8) {
+        unsigned long long word = 0;
+        memcpy(&word, data + i, min<size_t>(8, size - i));
+        result = rotate(result ^ (word * prime2), 27) * prime1;
+    }
+
+    // Mixes the last words into all bits.
+    result ^= result >> 33;
+    result *= prime2;
+    result ^= result >> 29;
+    result *= prime1;
+    result ^= result >> 32;
+    return result;
+}
+
+string rvm::ASTCache::path(const SourceBuffer& source) const {
+    return path(hash(source.code()));
+}
+
+string rvm::ASTCache::path(unsigned long long key) const {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.rast", key);
+    return (filesystem::path(_directory) / name).string();
+}
+
+bool rvm::ASTCache::store(const SourceBuffer& source, Parser& module) {
+    Tree& tree = module.tree();
+    for (NodeId member : module.members()) {
+        if (tree.kind(member) == Kind::Function) tree.codeBlock(member);
+    }
+    const TokenBuffer& tokens = module.tokens();
+    if (tokens.failed() || module.failed()) return false;
+
+    // Identifiers are numbered in the file, Atom ids are only valid in this process.
+    vector<unsigned int> valueIndices(tokens._valueIndexData, tokens._valueIndexData + tokens._size);
+    unordered_map<unsigned int, unsigned int> atomIndices;
+    vector<Slice> atoms;
+    string atomBytes;
+    for (size_t token = 0; token < tokens._size; token++) {
+        if (tokens._kindData[token] != TokenType::Identifier) continue;
+        auto inserted = atomIndices.emplace(valueIndices[token], (unsigned int)atoms.size());
+        if (inserted.second) {
+            string_view name = Atom(valueIndices[token]).view();
+            atoms.push_back({ (unsigned int)atomBytes.size(), (unsigned int)name.size() });
+            atomBytes += name;
+        }
+        valueIndices[token] = inserted.first->second;
+    }
+
+    vector<Slice> strings;
+    string stringBytes;
+    strings.reserve(tokens._strings.size());
+    for (string_view text : tokens._strings) {
+        strings.push_back({ (unsigned int)stringBytes.size(), (unsigned int)text.size() });
+        stringBytes += text;
+    }
+
+    Output outputs[SectionCount] {
+        { tokens._kindData, tokens._size },
+        { tokens._offsetData, tokens._size },
+        { tokens._lengthData, tokens._size },
+        { valueIndices.data(), valueIndices.size() },
+        { tokens._integers.data(), tokens._integers.size() },
+        { tokens._floats.data(), tokens._floats.size() },
+        { strings.data(), strings.size() },
+        { stringBytes.data(), stringBytes.size() },
+        { atoms.data(), atoms.size() },
+        { atomBytes.data(), atomBytes.size() },
+        { tree._nodeData, tree._size },
+        { tree._childData, tree._children.size() },
+        { module.members().data(), module.members().size() },
+    };
+
+    Header header {};
+    memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.byteOrder = byteOrderMark;
+    header.nodeSize = sizeof(Node);
+    header.sourceHash = hash(source.code());
+    string target = path(header.sourceHash);
+    header.sourceSize = source.size();
+    size_t offset = align(sizeof(Header));
+    for (int section = 0; section < SectionCount; section++) {
+        header.offsets[section] = offset;
+        header.counts[section] = outputs[section].count;
+        offset = align(offset + outputs[section].count * elementSize[section]);
+    }
+
+    // Written aside and renamed over the cache file, so a concurrent load sees a whole file or none.
+    ostringstream unique;
+    unique << target << "." << this_thread::get_id() << "." << chrono::steady_clock::now().time_since_epoch().count();
+    string temporary = unique.str();
+    {
+        ofstream file(temporary, ios::binary | ios::trunc);
+        if (!file) throw system_error(errno, generic_category(), temporary);
+        const char zeros[8] {};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+        file.write(zeros, align(sizeof(Header)) - sizeof(Header));
+        for (int section = 0; section < SectionCount; section++) {
+            size_t bytes = outputs[section].count * elementSize[section];
+            file.write(static_cast<const char*>(outputs[section].data), bytes);
+            file.write(zeros, align(bytes) - bytes);
+        }
+        if (!file.flush()) {
+            int error = errno;
+            file.close();
+            filesystem::remove(temporary);
+            throw system_error(error, generic_category(), temporary);
+        }
+    }
+    error_code error;
+    filesystem::rename(temporary, target, error);
+    if (error) {
+        filesystem::remove(temporary);
+        throw system_error(error, target);
+    }
+    return true;
+}
+
+unique_ptr<CachedModule> rvm::ASTCache::load(const SourceBuffer& source) {
+    unsigned long long key = hash(source.code());
+    string file = path(key);
+    unique_ptr<CachedModule> module(new CachedModule(unique_ptr<TokenBuffer>(new TokenBuffer())));
+
+#if defined(_WIN32)
+    ifstream input(file, ios::binary);
+    if (!input) return nullptr;
+    stringstream contents;
+    contents << input.rdbuf();
+    string text = contents.str();
+    if (text.empty()) return nullptr;
+    module->_owned.assign(text.begin(), text.end());
+    module->_data = module->_owned.data();
+    module->_size = module->_owned.size();
+#else
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(Header)) {
+        close(fd);
+        return nullptr;
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) return nullptr;
+    module->_data = static_cast<const char*>(mapped);
+    module->_size = size;
+#endif
+
+    if (module->_size < sizeof(Header)) return nullptr;
+    const Header& header = *reinterpret_cast<const Header*>(module->_data);
+    if (memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version || header.byteOrder != byteOrderMark
+        || header.nodeSize != sizeof(Node) || header.sourceSize != source.size() || header.sourceHash != key) {
+        return nullptr;
+    }
+
+    const char* sections[SectionCount];
+    for (int section = 0; section < SectionCount; section++) {
+        unsigned long long offset = header.offsets[section];
+        if (offset % 8 != 0 || offset > module->_size || header.counts[section] > (module->_size - offset) / elementSize[section]) {
+            return nullptr;
+        }
+        sections[section] = module->_data + offset;
+    }
+    auto count = [&header](Section section) { return size_t(header.counts[section]); };
+    if (count(Offsets) != count(Kinds) || count(Lengths) != count(Kinds) || count(ValueIndices) != count(Kinds) || count(Kinds) == 0) {
+        return nullptr;
+    }
+
+    TokenBuffer& tokens = *module->_tokens;
+    tokens._kindData = reinterpret_cast<const TokenType*>(sections[Kinds]);
+    tokens._offsetData = reinterpret_cast<const unsigned int*>(sections[Offsets]);
+    tokens._lengthData = reinterpret_cast<const unsigned int*>(sections[Lengths]);
+    tokens._valueIndexData = reinterpret_cast<const unsigned int*>(sections[ValueIndices]);
+    tokens._integerData = reinterpret_cast<const unsigned long long*>(sections[Integers]);
+    tokens._floatData = reinterpret_cast<const double*>(sections[Floats]);
+    tokens._size = count(Kinds);
+
+    const Slice* strings = reinterpret_cast<const Slice*>(sections[Strings]);
+    tokens._strings.reserve(count(Strings));
+    for (size_t i = 0; i < count(Strings); i++) {
+        if (strings[i].offset + (size_t)strings[i].length > count(StringBytes)) return nullptr;
+        tokens._strings.push_back(string_view(sections[StringBytes] + strings[i].offset, strings[i].length));
+    }
+
+    const Slice* atoms = reinterpret_cast<const Slice*>(sections[Atoms]);
+    tokens._atoms.reserve(count(Atoms));
+    for (size_t i = 0; i < count(Atoms); i++) {
+        if (atoms[i].offset + (size_t)atoms[i].length > count(AtomBytes)) return nullptr;
+        tokens._atoms.push_back(Atom::intern(string_view(sections[AtomBytes] + atoms[i].offset, atoms[i].length)).id());
+    }
+    // An empty atom table reads value indices as Atom ids, a module without identifiers must not have any.
+    if (tokens._atoms.empty()) tokens._atoms.push_back(0);
+
+    Tree& tree = module->_tree;
+    tree._nodeData = reinterpret_cast<const Node*>(sections[Nodes]);
+    tree._childData = reinterpret_cast<const NodeId*>(sections[NodeChildren]);
+    tree._size = count(Nodes);
+
+    const NodeId* members = reinterpret_cast<const NodeId*>(sections[Members]);
+    module->_members.assign(members, members + count(Members));
+    return module;
+}
@@ -0,0 +1,79 @@
+#ifndef RVM_ASTCACHE_H
+#define RVM_ASTCACHE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include "source.h"
+#include "tokenbuffer.h"
+#include "ast.h"
+
+namespace rvm {
+    class Parser;
+
+    /// A module loaded by the ASTCache, its tokens and Tree read the cache file where it is mapped.
+    /// Used like a parsed Parser, the SourceBuffer it was loaded for must outlive it.
+    class CachedModule {
+        const char* _data;
+        size_t _size;
+        // The file contents where it is read instead of mapped.
+        std::vector<char> _owned;
+
+        std::unique_ptr<TokenBuffer> _tokens;
+        ast::Tree _tree;
+        std::vector<ast::NodeId> _members;
+
+        friend class ASTCache;
+        CachedModule(std::unique_ptr<TokenBuffer> tokens);
+
+    public:
+        CachedModule(const CachedModule&) = delete;
+        CachedModule& operator=(const CachedModule&) = delete;
+        ~CachedModule();
+
+        const TokenBuffer& tokens() const { return *_tokens; }
+        const std::vector<ast::NodeId>& members() const { return _members; }
+        ast::Tree& tree() { return _tree; }
+
+        template<typename Visitor>
+        void visit(Visitor* visitor) {
+            for(auto member : _members) visitor->visit(_tree, member);
+        }
+    };
+
+    /// A directory of parsed modules, one file per source named by the hash of its code.
+    /// A file holds the token and node arrays as they are in memory, with offsets in place of pointers
+    /// and identifiers as indices into its own string table, so loading maps it and reads the arrays
+    /// where they are. Only Atoms and string literals are set up per entry, nodes are never touched.
+    ///
+    /// Files start with a version, a file of another version, byte order or source is a miss.
+    class ASTCache {
+        std::string _directory;
+
+        std::string path(unsigned long long key) const;
+
+    public:
+        /// Bumped on any change to the file layout, the Node layout or the meaning of its fields.
+        static const unsigned int version = 1;
+
+        /// Creates directory if it does not exist, throws std::system_error if it can not be created.
+        ASTCache(std::string directory);
+
+        /// A 64 bit hash of code, the cache key of a module.
+        static unsigned long long hash(std::string_view code);
+
+        /// The file of source in the cache, whether it exists or not.
+        std::string path(const SourceBuffer& source) const;
+
+        /// Writes the parsed module, deferred bodies are parsed first.
+        /// Modules with errors are not cached and return false.
+        /// Throws std::system_error if the file can not be written.
+        bool store(const SourceBuffer& source, Parser& module);
+
+        /// The module of source, or null when it is not in the cache or the file is stale.
+        std::unique_ptr<CachedModule> load(const SourceBuffer& source);
+    };
+};
+
+#endif
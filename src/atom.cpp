@@ -0,0 +1,89 @@
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <shared_mutex>
+#include <mutex>
+#include <cstring>
+
+#include "atom.h"
+
+using namespace std;
+using namespace rvm;
+
+namespace {
+    const size_t atomChunkSize = 64 * 1024;
+
+    // Owns the characters of all interned strings.
+    // Chunks are never reallocated so views into them stay valid.
+    // Lexer threads intern concurrently, lookups of known atoms share the lock.
+    class AtomTable {
+        shared_mutex _mutex;
+
+        vector<unique_ptr<char[]> > _chunks;
+        char* _chunkCurrent;
+        char* _chunkEnd;
+
+        vector<string_view> _names;
+        unordered_map<string_view, unsigned int> _ids;
+
+        string_view store(string_view text) {
+            if (static_cast<size_t>(_chunkEnd - _chunkCurrent) < text.size()) {
+                size_t size = text.size() > atomChunkSize ? text.size() : atomChunkSize;
+                _chunks.push_back(make_unique<char[]>(size));
+                _chunkCurrent = _chunks.back().get();
+                _chunkEnd = _chunkCurrent + size;
+            }
+            char* stored = _chunkCurrent;
+            memcpy(stored, text.data(), text.size());
+            _chunkCurrent += text.size();
+            return string_view(stored, text.size());
+        }
+
+    public:
+        AtomTable() : _chunkCurrent(nullptr), _chunkEnd(nullptr) {
+            // Atom 0 is the empty string, the value of default constructed Atoms.
+            _names.push_back(string_view());
+            _ids[string_view()] = 0;
+        }
+
+        unsigned int intern(string_view text) {
+            {
+                shared_lock<shared_mutex> lock(_mutex);
+                auto found = _ids.find(text);
+                if (found != _ids.end()) return found->second;
+            }
+
+            unique_lock<shared_mutex> lock(_mutex);
+            auto found = _ids.find(text);
+            if (found != _ids.end()) return found->second;
+
+            string_view stored = store(text);
+            unsigned int id = static_cast<unsigned int>(_names.size());
+            _names.push_back(stored);
+            _ids.emplace(stored, id);
+            return id;
+        }
+
+        string_view name(unsigned int id) {
+            shared_lock<shared_mutex> lock(_mutex);
+            return _names[id];
+        }
+    };
+
+    AtomTable& atomTable() {
+        static AtomTable table;
+        return table;
+    }
+}
+
+Atom rvm::Atom::intern(string_view text) {
+    return Atom(atomTable().intern(text));
+}
+
+string_view rvm::Atom::view() const {
+    return atomTable().name(_id);
+}
+
+ostream& operator << (ostream& out, const Atom& atom) {
+    return out << atom.view();
+}
@@ -0,0 +1,36 @@
+#ifndef RVM_ATOM_H
+#define RVM_ATOM_H
+
+#include <string>
+#include <string_view>
+#include <iostream>
+
+namespace rvm {
+    /// An Atom is an interned identifier.
+    /// Equal strings intern to the same Atom, so Atoms compare as integers
+    /// and their text lives for the lifetime of the process.
+    class Atom {
+        unsigned int _id;
+
+    public:
+        Atom() : _id(0) {}
+        explicit Atom(unsigned int id) : _id(id) {}
+
+        /// Returns the Atom for text, adding it to the atom table if this is its first occurrence.
+        static Atom intern(std::string_view text);
+
+        unsigned int id() const { return _id; }
+        std::string_view view() const;
+        std::string str() const { return std::string(view()); }
+
+        operator std::string_view() const { return view(); }
+
+        bool operator == (const Atom& other) const { return _id == other._id; }
+        bool operator != (const Atom& other) const { return _id != other._id; }
+        bool operator < (const Atom& other) const { return _id < other._id; }
+    };
+};
+
+std::ostream& operator << (std::ostream& out, const rvm::Atom& atom);
+
+#endif
@@ -0,0 +1,529 @@
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+
+#include "benchmark.h"
+#include "lexer.h"
+#include "tokenbuffer.h"
+#include "parser.h"
+#include "threadpool.h"
+#include "scan.h"
+#include "astcache.h"
+#include "binder.h"
+#include "typechecker.h"
+#include "query.h"
+
+using namespace std;
+using namespace rvm;
+
+namespace {
+    typedef chrono::steady_clock Clock;
+
+    double secondsSince(Clock::time_point start) {
+        return chrono::duration<double>(Clock::now() - start).count();
+    }
+}
+
+string rvm::generateBenchmarkModule(unsigned int count) {
+    string code;
+    for (unsigned int i = 0; i < count; i++) {
+        string index = to_string(i);
+        code += "declare function external" + index + "(angle: float, count: int): float;\r\n";
+        code += "function generated" + index + "(value: float, label: string): float {\r\n";
+        code += "    const scaled = external" + index + "(value * 2.5e-3, " + index + ") + value / 16.0;\r\n";
+        code += "    const mask = (" + index + " << 3) & 255 | 7 ^ 1024 >> 2;\r\n";
+        code += "    const check = scaled >= 0.0 && mask != 0 || !(scaled <= 1.0);\r\n";
+        code += "    const text = \"generated function label number " + index + "\";\r\n";
+        code += "    return check ? scaled : -scaled;\r\n";
+        code += "}\r\n";
+    }
+    return code;
+}
+
+namespace {
+    // Deeply indented code with long string literals, the shape of generated string tables.
+    string generateStringTableModule(unsigned int count) {
+        string code = "function table(): string {\r\n";
+        string indent(48, ' ');
+        for (unsigned int i = 0; i < count; i++) {
+            code += indent + "const entry" + to_string(i) + " = \"";
+            code += "SELECT name, value, description FROM generated_table WHERE id = ? AND kind = 'entry'";
+            code += "\";\r\n";
+        }
+        code += "}\r\n";
+        return code;
+    }
+
+    // JSON templates in string literals, every one has escaped quotes and newlines to decode.
+    string generateJsonTemplateModule(unsigned int count) {
+        string code = "function templates(): string {\r\n";
+        for (unsigned int i = 0; i < count; i++) {
+            code += "    const template" + to_string(i) + " = \"";
+            code += R"({\n  \"id\": )" + to_string(i) + R"(,\n  \"name\": \"entry\",\n)";
+            code += R"(  \"query\": \"SELECT value FROM generated_table WHERE id = ?\",\n  \"unit\": \"\u{B0}C\"\n})";
+            code += "\";\r\n";
+        }
+        code += "}\r\n";
+        return code;
+    }
+
+    // Identifiers and strings outside ASCII, the shape of localized code.
+    string generateLocalizedModule(unsigned int count) {
+        string code;
+        for (unsigned int i = 0; i < count; i++) {
+            string index = to_string(i);
+            code += "function größe" + index + "(länge: float, breite: float): float {\r\n";
+            code += "    const 面積 = länge * breite;\r\n";
+            code += "    const подпись = \"Площадь участка номер " + index + "\";\r\n";
+            code += "    return 面積;\r\n";
+            code += "}\r\n";
+        }
+        return code;
+    }
+
+    // Constant tables of integers, hexadecimal masks and float weights, the shape of embedded lookup tables.
+    string generateNumberTableModule(unsigned int count) {
+        string code = "function weights(): float {\r\n";
+        unsigned long long state = 88172645463325252ULL;
+        for (unsigned int i = 0; i < count; i++) {
+            // xorshift, the same table on every run.
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            code += "    const w" + to_string(i) + " = ";
+            code += to_string(state % 100000) + " + 0x" + to_string(state % 9000 + 1000) + "ABCDEF";
+            code += " * " + to_string(double(state % 1000000) / 999983.0) + "e-" + to_string(state % 300) + ";\r\n";
+        }
+        code += "}\r\n";
+        return code;
+    }
+
+    // Long arithmetic and logic expressions over few statements, the shape of generated numeric code.
+    string generateExpressionModule(unsigned int count) {
+        string code;
+        for (unsigned int i = 0; i < count; i++) {
+            string index = to_string(i);
+            code += "function expression" + index + "(a: int, b: int, c: float): float {\r\n";
+            code += "    const x = a * 3 + (b << 2) - c / 4.5 % 7 + -a * ~b - (a + b) * (c - " + index + ") / 2;\r\n";
+            code += "    const y = x > 0 && a <= b || !(c >= 1.5) && a != b | b ^ 255 & a == " + index + ";\r\n";
+            code += "    return y ? x * x + a * b - c : x >> 1 <= a - b ? -x : a * (b + c * (a - b * (c + " + index + ")));\r\n";
+            code += "}\r\n";
+        }
+        return code;
+    }
+
+    // An API binding with an overload of log for every list of one to five int, float and string arguments,
+    // and count functions calling it, the shape of code using a logging or math library.
+    string generateBindingModule(unsigned int count) {
+        const char* types[] = { "int", "float", "string" };
+        string code;
+        unsigned int overloads = 0;
+        for (unsigned int arity = 1, combinations = 3; arity <= 5; arity++, combinations *= 3) {
+            for (unsigned int combination = 0; combination < combinations; combination++) {
+                code += "declare function log(";
+                for (unsigned int i = 0, rest = combination; i < arity; i++, rest /= 3) {
+                    code += (i ? ", a" : "a") + to_string(i) + ": " + types[rest % 3];
+                }
+                code += overloads++ % 2 ? "): float;\r\n" : "): int;\r\n";
+            }
+        }
+        for (unsigned int i = 0; i < count; i++) {
+            string index = to_string(i);
+            code += "function caller" + index + "(): float {\r\n";
+            code += "    const a = log(" + index + ", 2.5, \"" + index + "\");\r\n";
+            code += "    const b = log(log(1.5, " + index + "), \"label\", 4, 0.5, \"tail\");\r\n";
+            code += "    const c = log(\"x\", log(" + index + "), log(" + index + ".5, 1, 2));\r\n";
+            code += "    const d = log(log(log(" + index + ", 1), 2.5), 3, \"y\", 0.25);\r\n";
+            code += "}\r\n";
+        }
+        return code;
+    }
+
+    // A library of count functions calling each other in chains of 100, and a main calling the first of used chains.
+    string generateLibraryModule(unsigned int count, unsigned int used) {
+        string code = "function main(): int {\r\n";
+        for (unsigned int chain = 0; chain < used; chain++) code += "    const r" + to_string(chain) + " = library" + to_string(chain * 100) + "(" + to_string(chain) + ");\r\n";
+        code += "}\r\n";
+        for (unsigned int i = 0; i < count; i++) {
+            string index = to_string(i);
+            code += "function library" + index + "(x: int): int {\r\n";
+            if (i % 100 != 99) code += "    const next = library" + to_string(i + 1) + "(" + index + ");\r\n";
+            code += "    const scaled = scale(" + index + ", 2.5);\r\n";
+            code += "}\r\n";
+        }
+        code += "declare function scale(x: int, factor: float): float;\r\n";
+        return code;
+    }
+
+    // Parenthesized expressions nested depth levels, the shape of machine-generated formulas.
+    string generateNestedModule(unsigned int count, unsigned int depth) {
+        string code;
+        for (unsigned int i = 0; i < count; i++) {
+            code += "function nested" + to_string(i) + "(a: int, b: int): int {\r\n    return ";
+            for (unsigned int level = 0; level < depth; level++) code += level % 2 ? "f(a, -" : "(b * ";
+            code += to_string(i);
+            for (unsigned int level = 0; level < depth; level++) code += ")";
+            code += ";\r\n}\r\n";
+        }
+        return code;
+    }
+
+    void measureLexer(const char* name, string code, unsigned int repeat) {
+        SourceBuffer source(move(code));
+        unsigned long long tokens = 0;
+        auto start = Clock::now();
+        for (unsigned int i = 0; i < repeat; i++) {
+            Lexer lexer(source);
+            for (auto token = lexer.begin(), end = lexer.end(); token != end; ++token) tokens++;
+        }
+        double seconds = secondsSince(start);
+
+        double megabytes = double(source.size()) * repeat / (1024 * 1024);
+        cout << "Lexer " << name << ": " << megabytes << " MB, " << tokens << " tokens in " << seconds << " s, "
+            << megabytes / seconds << " MB/s, " << tokens / seconds / 1e6 << " M tokens/s" << endl;
+    }
+
+    void measureUtf8Validation(const char* name, string code, unsigned int repeat) {
+        SourceBuffer source(move(code));
+        size_t valid = 0;
+        auto start = Clock::now();
+        for (unsigned int i = 0; i < repeat; i++) {
+            valid += scan::findInvalidUtf8(source.begin(), source.end()) == source.end();
+        }
+        double seconds = secondsSince(start);
+
+        double megabytes = double(source.size()) * repeat / (1024 * 1024);
+        cout << "UTF-8 validation " << name << ": " << megabytes << " MB, " << valid << " valid in " << seconds << " s, "
+            << megabytes / seconds << " MB/s" << endl;
+    }
+
+    // Lexes into a TokenBuffer, in parallel chunks when pool is not null.
+    void measureTokenBuffer(const char* name, string code, unsigned int repeat, ThreadPool* pool = nullptr) {
+        SourceBuffer source(move(code));
+        unsigned long long tokens = 0;
+        auto start = Clock::now();
+        for (unsigned int i = 0; i < repeat; i++) {
+            TokenBuffer buffer = pool ? TokenBuffer(source, *pool) : TokenBuffer(source);
+            tokens += buffer.size();
+        }
+        double seconds = secondsSince(start);
+
+        double megabytes = double(source.size()) * repeat / (1024 * 1024);
+        cout << "TokenBuffer " << name << ": " << megabytes << " MB, " << tokens << " tokens in " << seconds << " s, "
+            << megabytes / seconds << " MB/s, " << tokens / seconds / 1e6 << " M tokens/s" << endl;
+    }
+
+    // Parses a module once, lexing is timed apart from parsing and the module is timed until it is freed.
+    // Lexing and parsing run in parallel when pool is not null.
+    void measureParser(const char* name, string code, ThreadPool* pool = nullptr) {
+        SourceBuffer source(move(code));
+        size_t lines = 0;
+        for (char c : source.code()) lines += c == '\n';
+
+        auto start = Clock::now();
+        auto module = pool ? make_unique<Parser>(source, *pool) : make_unique<Parser>(source);
+        double lexSeconds = secondsSince(start);
+
+        start = Clock::now();
+        module->parseModule();
+        double parseSeconds = secondsSince(start);
+        size_t members = module->members().size();
+        size_t nodes = module->tree().size();
+        size_t bytes = module->tree().bytes();
+
+        start = Clock::now();
+        module.reset();
+        double freeSeconds = secondsSince(start);
+
+        cout << "Parser " << name << ": " << lines << " lines, " << members << " members, lexed in " << lexSeconds << " s, parsed in "
+            << parseSeconds << " s, " << lines / parseSeconds / 1e6 << " M lines/s, " << nodes << " nodes in "
+            << bytes / (1024 * 1024) << " MB, freed in " << freeSeconds << " s" << endl;
+    }
+
+    // Parses a module with deferred bodies, then the bodies of one in stride functions, like a program using part of a library.
+    void measureDeferredParser(const char* name, string code, size_t stride) {
+        SourceBuffer source(move(code));
+        Parser module(source);
+
+        auto start = Clock::now();
+        module.parseModule(true);
+        double parseSeconds = secondsSince(start);
+        ast::Tree& tree = module.tree();
+        size_t bytes = tree.bytes();
+
+        start = Clock::now();
+        size_t functions = 0, parsed = 0;
+        for (auto member : module.members()) {
+            if (tree.kind(member) != ast::Kind::Function || functions++ % stride != 0) continue;
+            parsed += tree.codeBlock(member) != ast::noNode;
+        }
+        double bodySeconds = secondsSince(start);
+
+        cout << "Parser " << name << " deferred: " << functions << " functions in " << parseSeconds << " s, "
+            << bytes / (1024 * 1024) << " MB of nodes, " << parsed << " bodies parsed on demand in " << bodySeconds << " s, "
+            << (tree.bytes() - bytes) / (1024 * 1024) << " MB of nodes" << endl;
+    }
+
+    // Edits a function in the middle of a module as typing would, one character changed and an operand added and removed,
+    // and compares the latency of an edit to parsing the module again.
+    void measureIncrementalParser(const char* name, string code, const string& function, unsigned int repeat) {
+        SourceBuffer source(move(code));
+        Parser module(source);
+        auto start = Clock::now();
+        module.parseModule();
+        double parseSeconds = secondsSince(start);
+
+        size_t body = source.code().find("{", source.code().find(function));
+        unsigned int digit = static_cast<unsigned int>(source.code().find_first_of("0123456789", body));
+        unsigned int semicolon = static_cast<unsigned int>(source.code().find(";", body));
+        size_t nodes = module.tree().size();
+
+        start = Clock::now();
+        for (unsigned int i = 0; i < repeat; i++) {
+            module.edit(digit, 1, i % 2 ? "7" : "3");
+            module.edit(semicolon, 0, " + 1");
+            module.edit(semicolon, 4, "");
+        }
+        double editSeconds = secondsSince(start) / (repeat * 3);
+
+        cout << "Parser " << name << " edits: parsed in " << parseSeconds << " s, " << editSeconds * 1e3 << " ms per edit, "
+            << parseSeconds / editSeconds << " times faster, " << module.tree().size() - nodes << " nodes added by "
+            << repeat * 3 << " edits" << endl;
+    }
+
+    // A cold front end misses the cache, lexes, parses and stores the module, a warm one hashes it and maps the file.
+    void measureASTCache(const char* name, string code, ASTCache& cache) {
+        SourceBuffer source(move(code));
+        remove(cache.path(source).c_str());
+
+        auto start = Clock::now();
+        auto missed = cache.load(source);
+        Parser module(source);
+        module.parseModule();
+        double parseSeconds = secondsSince(start);
+        cache.store(source, module);
+        double coldSeconds = secondsSince(start);
+
+        start = Clock::now();
+        auto loaded = cache.load(source);
+        double warmSeconds = secondsSince(start);
+        size_t nodes = loaded ? loaded->tree().size() : 0;
+
+        cout << "AST cache " << name << ": " << module.tree().size() << " nodes, cold " << coldSeconds << " s of which "
+            << parseSeconds << " s lexing and parsing, warm " << warmSeconds << " s loading " << nodes << " nodes, "
+            << coldSeconds / warmSeconds << " times faster" << endl;
+    }
+}
+
+namespace {
+    // Binds the module's functions, then resolves every name from a scope depth blocks below the globals
+    // and every block name from the innermost scope, the lookups of type checking a nested function body.
+    void measureNameScope(const char* name, string code, unsigned int depth, unsigned int repeat) {
+        SourceBuffer source(move(code));
+        Parser module(source);
+        module.parseModule();
+
+        auto start = Clock::now();
+        Binder globals;
+        module.visit(&globals);
+        double bindSeconds = secondsSince(start);
+
+        vector<unique_ptr<NameScope> > blocks;
+        vector<Atom> names;
+        NameScope* scope = &globals;
+        for (unsigned int i = 0; i < depth; i++) {
+            blocks.push_back(make_unique<NameScope>(scope));
+            scope = blocks.back().get();
+            for (unsigned int j = 0; j < 4; j++) {
+                Atom local = Atom::intern("local" + to_string(i) + "_" + to_string(j));
+                scope->addSymbolDeclaration(local, ast::noNode);
+                names.push_back(local);
+            }
+        }
+        for (unsigned int i = 0; i < globals.size(); i++) names.push_back(Atom::intern("generated" + to_string(i)));
+
+        size_t found = 0;
+        start = Clock::now();
+        for (unsigned int i = 0; i < repeat; i++) {
+            for (auto name : names) found += scope->lookup(name) != nullptr;
+        }
+        double lookupSeconds = secondsSince(start);
+
+        cout << "Name scope " << name << ": " << globals.size() << " globals bound in " << bindSeconds << " s, "
+            << lookupSeconds * 1e9 / (repeat * names.size()) << " ns per lookup through " << depth << " scopes, "
+            << found << " found" << endl;
+    }
+}
+
+namespace {
+    // Type checks a module with many overloads of a name, every call resolves against all of them.
+    void measureTypeChecker(const char* name, string code, ThreadPool* pool = nullptr) {
+        SourceBuffer source(move(code));
+        DiagnosticEngine diagnostics;
+        Parser module(source, &diagnostics);
+        module.parseModule();
+        Binder globals;
+        module.visit(&globals);
+
+        size_t calls = 0;
+        for (char c : source.code()) calls += c == '(';
+
+        auto start = Clock::now();
+        auto checker = pool ? make_unique<TypeChecker>(&globals, *pool, &diagnostics) : make_unique<TypeChecker>(&globals, &diagnostics);
+        checker->check(&module);
+        double checkSeconds = secondsSince(start);
+
+        cout << "Type checker " << name << ": " << module.members().size() << " members checked in " << checkSeconds << " s, "
+            << checkSeconds * 1e9 / calls << " ns per call or declaration, " << checker->types().size() << " types, "
+            << diagnostics.size() << " errors" << endl;
+    }
+}
+
+namespace {
+    // Checks a library with deferred bodies eagerly, then on demand from main, which only parses and checks the bodies it reaches.
+    void measureQueryEngine(const char* name, string code) {
+        SourceBuffer source(move(code));
+        double eagerSeconds, demandSeconds;
+        size_t queries;
+        {
+            auto start = Clock::now();
+            Parser module(source);
+            module.parseModule(true);
+            Binder globals;
+            module.visit(&globals);
+            TypeChecker checker(&globals);
+            checker.check(&module);
+            eagerSeconds = secondsSince(start);
+        }
+        {
+            auto start = Clock::now();
+            Parser module(source);
+            module.parseModule(true);
+            Binder globals;
+            module.visit(&globals);
+            QueryEngine engine(&module, &globals);
+            engine.checkReachable(Atom::intern("main"));
+            demandSeconds = secondsSince(start);
+            queries = engine.size();
+        }
+
+        cout << "Query engine " << name << ": parsed and checked eagerly in " << eagerSeconds << " s, from main in " << demandSeconds
+            << " s answering " << queries << " queries, " << eagerSeconds / demandSeconds << " times faster" << endl;
+    }
+}
+
+namespace {
+    // Edits function, replacing from with to and back, and checks the module again after each edit:
+    // binding and checking all of it as a new module, and updating a QueryEngine that checks the changed bodies.
+    // Both report the errors of the edited module, with deferBodies the syntax errors of bodies come from the body queries.
+    void measureIncrementalChecker(const char* name, string code, const string& function, const string& from, const string& to, unsigned int repeat, bool deferBodies = false) {
+        SourceBuffer source(move(code));
+        DiagnosticEngine diagnostics;
+        Parser module(source, &diagnostics);
+        module.parseModule(deferBodies);
+        Binder globals;
+        module.visit(&globals);
+        QueryEngine engine(&module, &globals, &diagnostics);
+        auto start = Clock::now();
+        engine.checkAll();
+        double firstSeconds = secondsSince(start);
+
+        unsigned int offset = static_cast<unsigned int>(source.code().find(from, source.code().find(function)));
+        double fullSeconds = 0, incrementalSeconds = 0;
+        size_t runs = engine.runs();
+        size_t fullErrors = 0, incrementalErrors = 0;
+        for (unsigned int i = 0; i < repeat; i++) {
+            bool back = i % 2;
+            module.edit(offset, static_cast<unsigned int>((back ? to : from).size()), back ? from : to);
+
+            DiagnosticEngine editedDiagnostics;
+            Parser edited(module.source(), &editedDiagnostics);
+            edited.parseModule(deferBodies);
+            start = Clock::now();
+            Binder editedGlobals;
+            edited.visit(&editedGlobals);
+            TypeChecker checker(&editedGlobals, &editedDiagnostics);
+            checker.check(&edited);
+            fullSeconds += secondsSince(start);
+            fullErrors += editedDiagnostics.size();
+
+            start = Clock::now();
+            engine.update();
+            engine.checkAll();
+            incrementalSeconds += secondsSince(start);
+
+            DiagnosticEngine reported;
+            engine.report(reported);
+            incrementalErrors += reported.size();
+        }
+        fullSeconds /= repeat;
+        incrementalSeconds /= repeat;
+
+        cout << "Incremental checker " << name << ": " << module.members().size() << " members checked in " << firstSeconds << " s, after an edit "
+            << fullSeconds * 1e3 << " ms binding and checking all, " << incrementalSeconds * 1e3 << " ms updating, "
+            << fullSeconds / incrementalSeconds << " times faster, " << double(engine.runs() - runs) / repeat << " queries run per edit, "
+            << incrementalErrors << " errors reported against " << fullErrors << endl;
+    }
+}
+
+void rvm::benchmarkLexer() {
+    measureLexer("module", generateBenchmarkModule(20000), 20);
+    measureLexer("string table", generateStringTableModule(100000), 20);
+    measureLexer("json templates", generateJsonTemplateModule(50000), 20);
+    measureLexer("number table", generateNumberTableModule(200000), 20);
+    measureLexer("localized", generateLocalizedModule(50000), 20);
+    measureUtf8Validation("module", generateBenchmarkModule(20000), 100);
+    measureUtf8Validation("localized", generateLocalizedModule(50000), 100);
+    measureTokenBuffer("module", generateBenchmarkModule(20000), 20);
+    measureTokenBuffer("string table", generateStringTableModule(100000), 20);
+    measureTokenBuffer("json templates", generateJsonTemplateModule(50000), 20);
+
+    ThreadPool& pool = ThreadPool::shared();
+    cout << "Parallel lexing on " << pool.size() << " threads" << endl;
+    measureTokenBuffer("module", generateBenchmarkModule(20000), 20, &pool);
+    measureTokenBuffer("string table", generateStringTableModule(100000), 20, &pool);
+}
+
+void rvm::benchmarkParser() {
+    // Eight lines per function, a module of a million lines, and the same in expression-heavy functions.
+    measureParser("module", generateBenchmarkModule(125000));
+    measureParser("expressions", generateExpressionModule(20000));
+    measureParser("nested", generateNestedModule(500, 5000));
+    measureDeferredParser("module", generateBenchmarkModule(125000), 100);
+    measureDeferredParser("expressions", generateExpressionModule(20000), 100);
+    measureIncrementalParser("module", generateBenchmarkModule(125000), "function generated62500(", 100);
+    measureIncrementalParser("expressions", generateExpressionModule(20000), "function expression10000(", 100);
+
+    ThreadPool& pool = ThreadPool::shared();
+    cout << "Parallel parsing on " << pool.size() << " threads" << endl;
+    measureParser("module", generateBenchmarkModule(125000), &pool);
+    measureParser("expressions", generateExpressionModule(20000), &pool);
+}
+
+void rvm::benchmarkASTCache() {
+    ASTCache cache((filesystem::temp_directory_path() / "rvm-ast-cache-benchmark").string());
+    measureASTCache("module", generateBenchmarkModule(125000), cache);
+    measureASTCache("expressions", generateExpressionModule(20000), cache);
+}
+
+void rvm::benchmarkNameScope() {
+    measureNameScope("module", generateBenchmarkModule(125000), 8, 20);
+}
+
+void rvm::benchmarkTypeChecker() {
+    measureTypeChecker("bindings", generateBindingModule(50000));
+
+    ThreadPool& pool = ThreadPool::shared();
+    cout << "Parallel type checking on " << pool.size() << " threads" << endl;
+    measureTypeChecker("bindings", generateBindingModule(50000), &pool);
+
+    measureQueryEngine("library", generateLibraryModule(100000, 10));
+
+    // A body edit checks the edited function, a signature edit its caller too.
+    measureIncrementalChecker("body", generateLibraryModule(10000, 10), "function library5001(", "2.5", "3.5", 100);
+    measureIncrementalChecker("signature", generateLibraryModule(10000, 10), "function library5001(", "x: int", "x: float", 100);
+    // Deferred bodies are parsed by the queries checking them, an edit breaking one parses the module again.
+    measureIncrementalChecker("deferred body", generateLibraryModule(10000, 10), "function library5001(", "2.5", "3.5", 100, true);
+    measureIncrementalChecker("deferred syntax error", generateLibraryModule(10000, 10), "function library5001(", "2.5)", "2.5", 100, true);
+}
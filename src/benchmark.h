@@ -0,0 +1,29 @@
+#ifndef RVM_BENCHMARK_H
+#define RVM_BENCHMARK_H
+
+#include <string>
+
+namespace rvm {
+    /// Generates a synthetic module with count functions, exercising most token types.
+    std::string generateBenchmarkModule(unsigned int count);
+
+    /// Lexes a synthetic module repeatedly and prints the throughput.
+    void benchmarkLexer();
+
+    /// Parses a synthetic module of a million lines and prints the parse time and AST memory,
+    /// eagerly and with deferred bodies of which only some are used.
+    void benchmarkParser();
+
+    /// Compares a cold front end, lexing, parsing and storing a module in the ASTCache, with a warm one loading it.
+    void benchmarkASTCache();
+
+    /// Binds the functions of a synthetic module and resolves names through a chain of block scopes.
+    void benchmarkNameScope();
+
+    /// Type checks calls to a name with hundreds of overloads, like code using an API binding module,
+    /// serially and with the function bodies checked in parallel, and a library eagerly and on demand from main.
+    /// Then checks a module of 10k functions again after editing one of them, in full and incrementally, also with deferred bodies.
+    void benchmarkTypeChecker();
+};
+
+#endif
@@ -6,10 +6,12 @@
 #include "source.h"
 #include "lexer.h"
 #include "parser.h"
+#include "diagnostics.h"
 #include "binder.h"
 #include "print.h"
 #include "types.h"
 #include "typechecker.h"
+#include "benchmark.h"
 
 using namespace std;
 using namespace rvm;
@@ -18,7 +20,8 @@ using namespace rvm::ast;
 /// EXPLORATION TESTS ///
 
 void printTokens(string program) {
-    Lexer lexer(program);
+    SourceBuffer source(program);
+    Lexer lexer(source);
     try {
         for (auto token : lexer) {
             if (token.type() != TokenType::Whitespace) {
@@ -26,8 +29,8 @@ void printTokens(string program) {
             }
         }
     }
-    catch(CompilerError e) {
-        cout << endl << e.what() << endl;
+    catch(const CompilerError& e) {
+        cout << endl << e.format(source) << endl;
     }
 }
 
@@ -56,14 +59,14 @@ void testSimpleProgramAST1() {
         "    return x;"s
         "}"s;
 
-    Lexer lexer(program);
     printTokens(program);
     cout << "====================" << endl;
 
-    Parser module(program);
+    SourceBuffer source(program);
+    Parser module(source);
     module.parseModule();
 
-    ASTPrinter printer;
+    ASTPrinter printer(source);
     module.visit(&printer);
 }
 
@@ -88,35 +91,37 @@ static LLVMContext TheContext;
 static IRBuilder<> Builder(TheContext);
 static std::unique_ptr<Module> TheModule;
 
-class LLIRCompiler : public ModuleMemberVisitor {
+class LLIRCompiler : public rvm::ast::Visitor<LLIRCompiler> {
 public:
-    void on(rvm::ast::Function* f) override {
-        // cout << "compile " << f->name() << endl;
+    void onFunction(NodeId f) {
+        // cout << "compile " << _tree->name(f) << endl;
 
         // Make the function type:  double(double,double) etc.
-        std::vector<Type*> Doubles(f->proto()->args().size(), Type::getFloatTy(TheContext));
+        auto args = _tree->args(_tree->proto(f));
+        std::vector<Type*> Doubles(args.size(), Type::getFloatTy(TheContext));
         FunctionType *FT = FunctionType::get(Type::getFloatTy(TheContext), Doubles, false);
-        llvm::Function *F = llvm::Function::Create(FT, llvm::Function::ExternalLinkage, f->name(), TheModule.get());
+        llvm::Function *F = llvm::Function::Create(FT, llvm::Function::ExternalLinkage, _tree->name(f).str(), TheModule.get());
 
         unsigned i = 0;
         for (auto &Arg : F->args()) {
-            auto name = f->proto()->args()[i++]->name();
-            Arg.setName(name);
+            auto name = _tree->name(args[i++]);
+            Arg.setName(name.str());
         }
     }
 
-    void on(rvm::ast::FunctionDeclaration* f) override {
-        // cout << "compile " << f->name() << endl;
+    void onFunctionDeclaration(NodeId f) {
+        // cout << "compile " << _tree->name(f) << endl;
 
         // Make the function type:  double(double,double) etc.
-        std::vector<Type*> Doubles(f->proto()->args().size(), Type::getFloatTy(TheContext));
+        auto args = _tree->args(_tree->proto(f));
+        std::vector<Type*> Doubles(args.size(), Type::getFloatTy(TheContext));
         FunctionType *FT = FunctionType::get(Type::getFloatTy(TheContext), Doubles, false);
-        llvm::Function *F = llvm::Function::Create(FT, llvm::Function::ExternalLinkage, f->name(), TheModule.get());
+        llvm::Function *F = llvm::Function::Create(FT, llvm::Function::ExternalLinkage, _tree->name(f).str(), TheModule.get());
 
         unsigned i = 0;
         for (auto &Arg : F->args()) {
-            auto name = f->proto()->args()[i++]->name();
-            Arg.setName(name);
+            auto name = _tree->name(args[i++]);
+            Arg.setName(name.str());
         }
     }
 };
@@ -131,21 +136,30 @@ void testSimpleProgramLLVM() {
         "    return x;"s
         "}"s;
 
-    Lexer lexer(program);
     printTokens(program);
     cout << "====================" << endl;
 
-    Parser module(program);
+    SourceBuffer source(program);
+    DiagnosticEngine diagnostics;
+    Parser module(source, &diagnostics);
     module.parseModule();
+    if (diagnostics.hasErrors()) {
+        diagnostics.print(cout, source);
+        return;
+    }
 
-    ASTPrinter printer;
+    ASTPrinter printer(source);
     module.visit(&printer);
 
     Binder globalSymbols;
     module.visit(&globalSymbols);
 
-    TypeChecker typeChecker(&globalSymbols);
+    TypeChecker typeChecker(&globalSymbols, &diagnostics);
     typeChecker.check(&module);
+    if (diagnostics.hasErrors()) {
+        diagnostics.print(cout, source);
+        return;
+    }
 
     module.visit(&typeChecker);
 
@@ -164,6 +178,16 @@ int main(int argl, char** argv) {
     // testSimpleProgram3();
     // cout << "testSimpleProgramAST1" << endl;
     // testSimpleProgramAST1();
+    // cout << "benchmarkLexer" << endl;
+    // benchmarkLexer();
+    // cout << "benchmarkParser" << endl;
+    // benchmarkParser();
+    // cout << "benchmarkASTCache" << endl;
+    // benchmarkASTCache();
+    // cout << "benchmarkNameScope" << endl;
+    // benchmarkNameScope();
+    // cout << "benchmarkTypeChecker" << endl;
+    // benchmarkTypeChecker();
 
     cout << "testSimpleProgramLLVM" << endl;
     testSimpleProgramLLVM();
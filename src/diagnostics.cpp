@@ -0,0 +1,20 @@
+#include <algorithm>
+
+#include "diagnostics.h"
+
+using namespace std;
+using namespace rvm;
+
+void rvm::DiagnosticEngine::print(ostream& out, const SourceBuffer& source) const {
+    // The lexer reports a whole module before the parser starts, so sort by location.
+    vector<const Diagnostic*> ordered;
+    ordered.reserve(_diagnostics.size());
+    for (auto& diagnostic : _diagnostics) ordered.push_back(&diagnostic);
+    stable_sort(ordered.begin(), ordered.end(), [](const Diagnostic* a, const Diagnostic* b) {
+        return a->span.start.offset < b->span.start.offset;
+    });
+
+    for (auto diagnostic : ordered) {
+        out << CompilerError(diagnostic->code, diagnostic->span).format(source) << endl;
+    }
+}
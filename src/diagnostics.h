@@ -0,0 +1,38 @@
+#ifndef RVM_DIAGNOSTICS_H
+#define RVM_DIAGNOSTICS_H
+
+#include <vector>
+#include <iostream>
+#include "source.h"
+
+namespace rvm {
+    struct Diagnostic {
+        ErrorCode code;
+        SourceSpan span;
+    };
+
+    /// Collects the errors of a compile instead of throwing them.
+    /// The Lexer, Parser and TypeChecker report here when given an engine, and recover to
+    /// the next token, statement or member, so one run reports every error in a module.
+    class DiagnosticEngine {
+        std::vector<Diagnostic> _diagnostics;
+
+    public:
+        DiagnosticEngine() {}
+
+        void report(ErrorCode code, SourceSpan span) { _diagnostics.push_back({ code, span }); }
+        void report(ErrorCode code, SourceLocation location) { report(code, { location, location }); }
+
+        bool hasErrors() const { return !_diagnostics.empty(); }
+        size_t size() const { return _diagnostics.size(); }
+        void clear() { _diagnostics.clear(); }
+
+        /// The diagnostics in the order they were reported.
+        const std::vector<Diagnostic>& diagnostics() const { return _diagnostics; }
+
+        /// Prints one line per diagnostic in source order, formatted like CompilerError::format.
+        void print(std::ostream& out, const SourceBuffer& source) const;
+    };
+};
+
+#endif
@@ -1,17 +1,23 @@
 #include <iostream>
-#include <map>
 #include <cassert>
+#include <cstring>
 
 #include "lexer.h"
+#include "lexertables.h"
+#include "scan.h"
+#include "number.h"
+#include "unicode.h"
 
 using namespace std;
 using namespace rvm;
+using namespace rvm::lexer;
 
 string tokenTypeNames[] = {
     "EoF",
+    "Error",
 
     // Complex expressions
-    "Identifier", // a-zA-Z_ and any code >127 followed by a-zA-Z_0-9 and any code >127
+    "Identifier", // a-zA-Z_ and Unicode XID_Start followed by a-zA-Z0-9_ and Unicode XID_Continue
     "Integer", // uint8, uint16, uint32, uint64
     "Float", // float32, float64
     "Whitespace", // \r\n, white space, tabulation
@@ -96,94 +102,33 @@ string rvm::name(TokenType type) {
     return tokenTypeNames[static_cast<unsigned int>(type)];
 }
 
-const map<string, TokenType> rvm::keywords {
-    { "declare", TokenType::DeclareKeyword },
-    { "function", TokenType::FunctionKeyword },
-    { "void"s, TokenType::VoidKeyword },
-    { "never"s, TokenType::NeverKeyword },
-    { "bool"s, TokenType::BoolKeyword },
-    { "int"s, TokenType::IntKeyword },
-    { "float"s, TokenType::FloatKeyword },
-    { "string"s, TokenType::StringKeyword },
-    { "var"s, TokenType::VarKeyword },
-    { "const"s, TokenType::ConstKeyword },
-    { "return"s, TokenType::ReturnKeyword },
-};
-
-const map<string, TokenType> rvm::operatorSymbols {
-    { "("s, TokenType::OpenParenthesis },
-    { ")"s, TokenType::CloseParenthesis },
-    { "["s, TokenType::LeftBracket },
-    { "]"s, TokenType::RightBracket },
-    { "{"s, TokenType::LeftBrace },
-    { "}"s, TokenType::RightBrace },
-    { ":"s, TokenType::Colon },
-    { ";"s, TokenType::Semicolon },
-    { ","s, TokenType::Comma },
-    { "."s, TokenType::Dot },
-
-    { "="s, TokenType::Assignment },
-    { "=="s, TokenType::Equal },
-    { "<"s, TokenType::Less },
-    { "<="s, TokenType::LessOrEqual },
-    { ">"s, TokenType::Greater },
-    { ">="s, TokenType::GreaterOrEqual },
-    { "!="s, TokenType::NotEqual },
-
-    { "+"s, TokenType::Plus },
-    { "-"s, TokenType::Minus },
-    { "*"s, TokenType::Multiply },
-    { "/"s, TokenType::Divide },
-    { "%"s, TokenType::Reminder },
-
-    { "&"s, TokenType::BitwiseAnd },
-    { "|"s, TokenType::BitwiseOr },
-    { "^"s, TokenType::BitwiseXOr },
-
-    { "?"s, TokenType::Question },
-    { "~"s, TokenType::BitComplement },
-    
-    { "++"s, TokenType::Increment },
-    { "--"s, TokenType::Decrement },
-
-    { "&&"s, TokenType::ConditionalAnd },
-    { "||"s, TokenType::ConditionalOr },
-    { "!"s, TokenType::ConditionalNot },
-    
-    { "<<"s, TokenType::LeftShift },
-    { ">>"s, TokenType::RightShift },
-
-    { "+="s, TokenType::AdditionAssignment },
-    { "-="s, TokenType::SubtractionAssignment },
-    { "*="s, TokenType::MultiplicationAssignment },
-    { "/="s, TokenType::DivisionAssignment },
-    { "%="s, TokenType::ReminderAssignment },
-
-    { "&="s, TokenType::BitAndAssignment },
-    { "|="s, TokenType::BitOrAssignment },
-    { "^="s, TokenType::BitXOrAssignment },
-    
-    { "<<="s, TokenType::LeftShiftAssignment },
-    { ">>="s, TokenType::RightShiftAssignment },
-
-    { "->", TokenType::PointerMemberAccess },
-    { "??", TokenType::NullCoalescing },
-    { "=>", TokenType::LambdaOperator },
-};
+inline bool Lexer::TokenIterator::isNumber() { return is(_lookaheadChar, DigitClass); }
+inline bool Lexer::TokenIterator::isWhitespace() { return is(_lookaheadChar, WhitespaceClass); }
+inline bool Lexer::TokenIterator::isIdentifierLeadChar() { return is(_lookaheadChar, IdentifierLeadClass); }
+inline bool Lexer::TokenIterator::isOperatorLeadChar() { return is(_lookaheadChar, OperatorLeadClass); }
+inline bool Lexer::TokenIterator::isIdentifierTailChar() { return is(_lookaheadChar, IdentifierTailClass); }
 
 Lexer::TokenIterator Lexer::begin() {
-    return TokenIterator(_code.begin(), _code.end());
+    return TokenIterator(_source, _source.begin(), &_strings, _diagnostics);
+}
+Lexer::TokenIterator Lexer::at(SourceLocation location) {
+    return TokenIterator(_source, _source.begin() + location.offset, &_strings, _diagnostics);
 }
 Lexer::TokenIterator Lexer::end() {
-    StringIterator end = _code.end();
-    return TokenIterator(end, end);
+    return TokenIterator(_source, _source.end(), &_strings, _diagnostics);
 }
 
-Lexer::TokenIterator::TokenIterator(StringIterator begin, StringIterator end) :
-    _current(begin),
-    _end(end),
-    _lookaheadChar(_current == _end ? 0 : *_current) {
-
+Lexer::TokenIterator::TokenIterator(const SourceBuffer& source, const Char* current, Arena* strings, DiagnosticEngine* diagnostics) :
+    _begin(source.begin()),
+    _current(current),
+    _end(source.end()),
+    _invalidUtf8(source.begin() + source.invalidUtf8().offset),
+    _strings(strings),
+    _diagnostics(diagnostics),
+    _lookaheadChar(*_current) {
+
+    // Lexing from the middle of the code, after an error, validation goes on from here.
+    if (_current > _invalidUtf8) _invalidUtf8 = scan::findInvalidUtf8(_current, _end);
     consumeNext();
 }
 
@@ -198,173 +143,338 @@ Lexer::TokenIterator Lexer::TokenIterator::operator++(int) {
     return result;
 }
 
+// Throws the error at the current character, or reports it and returns false to end the token as an Error.
+bool Lexer::TokenIterator::fail(ErrorCode code) {
+    return fail(code, _current);
+}
+
+bool Lexer::TokenIterator::fail(ErrorCode code, const Char* position) {
+    SourceLocation at(static_cast<unsigned int>(position - _begin));
+    if (_diagnostics == nullptr) throw CompilerError(code, at);
+    _diagnostics->report(code, at);
+    return false;
+}
+
 Char Lexer::TokenIterator::consumeChar() {
     Char c = _lookaheadChar;
-    if (c == '\n') {
-        _point.column = 1;
-        _point.line++;
-    } else {
-        _point.column++;
-    }
-    _lookaheadChar = _current == _end ? 0 : *++_current;
+    // The source is padded with zeros, so the lookahead past the end reads 0, which is EoF.
+    _lookaheadChar = *++_current;
     return c;
 }
 
+void Lexer::TokenIterator::advance(const Char* position) {
+    _current = position;
+    _lookaheadChar = *_current;
+}
+
 void Lexer::TokenIterator::consumeIdentifier() {
-    string identifier;
-    assert(isIdentifierLeadChar());
-    identifier += consumeChar();
+    const Char* start = _current;
+    const Char* next;
+    if (isIdentifierLeadChar()) {
+        consumeChar();
+    } else {
+        unicode::decode(_current, next);
+        advance(next);
+    }
 
-    while(isIdentifierTailChar()) identifier += consumeChar();
+    // ASCII runs are skipped by the vector kernel, only the characters it stops at outside ASCII are decoded.
+    while(true) {
+        advance(scan::skipIdentifierTail(_current));
+        if (leadKind(_lookaheadChar) != LeadKind::Unicode || _current >= _invalidUtf8) break;
+        if (!unicode::isXidContinue(unicode::decode(_current, next))) break;
+        advance(next);
+    }
 
-    auto keyword = keywords.find(identifier);
-    if (keyword == keywords.end()) {
-        _token._type = TokenType::Identifier;
-        _token._value = identifier;
+    string_view identifier(start, _current - start);
+    TokenType type = keywordType(identifier);
+    _token._type = type;
+    if (type == TokenType::Identifier) {
+        _token._value = Atom::intern(identifier);
     } else {
-        _token._type = keyword->second;
         _token._value = 0ULL;
     }
 }
 
+// Identifiers may start with a Unicode XID_Start character, any other character outside ASCII is unexpected.
+bool Lexer::TokenIterator::consumeUnicode() {
+    if (_current >= _invalidUtf8) return fail(InvalidUtf8);
+    const Char* next;
+    if (!unicode::isXidStart(unicode::decode(_current, next))) return fail(UnexpectedCharacter);
+    consumeIdentifier();
+    return true;
+}
+
 void Lexer::TokenIterator::consumeSingleCharToken(const Char& c, const TokenType& type) {
-    ++_point.column;
+    consumeChar();
     _token._type = type;
     _token._value = 0ULL;
 }
 
 void Lexer::TokenIterator::consumeWhitespace() {
-    while(isWhitespace()) consumeChar();
+    advance(scan::skipWhitespace(_current));
     _token._type = TokenType::Whitespace;
     _token._value = 0ULL;
 }
 
-void Lexer::TokenIterator::consumeString() {
+namespace {
+    unsigned int hexValue(Char c) {
+        return static_cast<unsigned int>(c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+    }
+
+    // Decodes the body of a string literal whose escape sequences were validated by the lexer,
+    // returns the decoded length. Runs between escapes are found with memchr and copied whole.
+    size_t decodeString(const Char* begin, const Char* end, Char* out) {
+        Char* start = out;
+        while (begin != end) {
+            const Char* backslash = static_cast<const Char*>(memchr(begin, '\\', end - begin));
+            if (backslash == nullptr) backslash = end;
+            memcpy(out, begin, backslash - begin);
+            out += backslash - begin;
+            if (backslash == end) break;
+
+            Char c = backslash[1];
+            begin = backslash + 2;
+            switch (c) {
+                case 'n': *out++ = '\n'; break;
+                case 't': *out++ = '\t'; break;
+                case 'r': *out++ = '\r'; break;
+                case '0': *out++ = '\0'; break;
+                case 'u': {
+                    unsigned int codePoint = 0;
+                    for (begin++; *begin != '}'; begin++) codePoint = codePoint << 4 | hexValue(*begin);
+                    begin++;
+                    // UTF-8
+                    if (codePoint < 0x80) {
+                        *out++ = static_cast<Char>(codePoint);
+                    } else if (codePoint < 0x800) {
+                        *out++ = static_cast<Char>(0xC0 | codePoint >> 6);
+                        *out++ = static_cast<Char>(0x80 | (codePoint & 0x3F));
+                    } else if (codePoint < 0x10000) {
+                        *out++ = static_cast<Char>(0xE0 | codePoint >> 12);
+                        *out++ = static_cast<Char>(0x80 | (codePoint >> 6 & 0x3F));
+                        *out++ = static_cast<Char>(0x80 | (codePoint & 0x3F));
+                    } else {
+                        *out++ = static_cast<Char>(0xF0 | codePoint >> 18);
+                        *out++ = static_cast<Char>(0x80 | (codePoint >> 12 & 0x3F));
+                        *out++ = static_cast<Char>(0x80 | (codePoint >> 6 & 0x3F));
+                        *out++ = static_cast<Char>(0x80 | (codePoint & 0x3F));
+                    }
+                    break;
+                }
+                default: *out++ = c; break; // \\ \" \'
+            }
+        }
+        return out - start;
+    }
+}
+
+// Literals without escape sequences are views into the source. The others are validated while scanning
+// and decoded into the strings Arena once their end is known, decoding never makes them longer.
+bool Lexer::TokenIterator::consumeString() {
     Char terminator = consumeChar();
     assert(terminator == '\'' || terminator == '"');
-    string value;
+    const Char* start = _current;
+    bool escaped = false;
     do {
-        if (isEoF()) throw CompilerError(UnexpectedEoF, _point);
-        if (_lookaheadChar == '\r' || _lookaheadChar == '\n') throw CompilerError(UnexpectedCharacter, _point);
+        advance(scan::skipStringBody(_current, terminator));
+        if (isEoF()) return fail(UnexpectedEoF);
+        if (_lookaheadChar == '\r' || _lookaheadChar == '\n') return fail(UnexpectedCharacter);
 
         if (_lookaheadChar == '\\') {
-            assert(false); // TODO: Handle escape sequences...
+            if (!consumeEscapeSequence()) {
+                skipStringRest(terminator);
+                return false;
+            }
+            escaped = true;
         } else if (_lookaheadChar == terminator) {
+            if (escaped) {
+                Char* decoded = static_cast<Char*>(_strings->allocate(_current - start, 1));
+                _token._value = string_view(decoded, decodeString(start, _current, decoded));
+            } else {
+                _token._value = string_view(start, _current - start);
+            }
             consumeChar();
-            _token._value = value;
-            return;
+            return true;
         } else {
-            value += consumeChar();
+            consumeChar();
         }
     }
     while(true);
 }
 
-void Lexer::TokenIterator::consumeDoubleQuotesString() {
+// After an invalid escape sequence the literal is one Error token up to its terminator, or to the end of the line
+// when it is not closed, so its text is not lexed as code. Escaped characters do not end it, the error was reported.
+void Lexer::TokenIterator::skipStringRest(Char terminator) {
+    do {
+        advance(scan::skipStringBody(_current, terminator));
+        if (isEoF() || _lookaheadChar == '\r' || _lookaheadChar == '\n') return;
+        Char c = consumeChar();
+        if (c == terminator) return;
+        // A backslash skips the character after it, unless that ends the line.
+        if (!isEoF() && _lookaheadChar != '\r' && _lookaheadChar != '\n') consumeChar();
+    }
+    while(true);
+}
+
+// \n \t \r \0 \\ \" \' and \u{X} with 1 to 6 hex digits naming a Unicode scalar value.
+bool Lexer::TokenIterator::consumeEscapeSequence() {
+    assert(_lookaheadChar == '\\');
+    consumeChar();
+    if (isEoF()) return fail(UnexpectedEoF);
+    if (_lookaheadChar == '\r' || _lookaheadChar == '\n') return fail(UnexpectedCharacter);
+    Char c = _lookaheadChar;
+    if (c == 'u') {
+        consumeChar();
+        if (_lookaheadChar != '{') return fail(InvalidEscapeSequence);
+        consumeChar();
+        const Char* digits = _current;
+        unsigned int codePoint = 0;
+        while (is(_lookaheadChar, HexDigitClass) && _current - digits < 6) {
+            codePoint = codePoint << 4 | hexValue(consumeChar());
+        }
+        if (_current == digits || _lookaheadChar != '}') return fail(InvalidEscapeSequence);
+        if (codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint <= 0xDFFF)) return fail(InvalidEscapeSequence);
+        consumeChar();
+        return true;
+    }
+    if (c != 'n' && c != 't' && c != 'r' && c != '0' && c != '\\' && c != '"' && c != '\'') return fail(InvalidEscapeSequence);
+    consumeChar();
+    return true;
+}
+
+bool Lexer::TokenIterator::consumeDoubleQuotesString() {
     assert(_lookaheadChar == '"');
     _token._type = TokenType::DoubleQuotesString;
-    consumeString();
+    return consumeString();
 }
 
-void Lexer::TokenIterator::consumeSingleQuotesString() {
+bool Lexer::TokenIterator::consumeSingleQuotesString() {
     assert(_lookaheadChar == '\'');
     _token._type = TokenType::SingleQuotesString;
-    consumeString();
+    return consumeString();
 }
 
-void Lexer::TokenIterator::consumeNumber() {
+bool Lexer::TokenIterator::consumeNumber() {
     assert(isNumber());
-    string number;
+    const Char* start = _current;
     Char lead = consumeChar();
-    number += lead;
 
-    bool hasFrac = false;
-    bool hasExp = false;
+    if (lead == '0' && (_lookaheadChar == 'x' || _lookaheadChar == 'X')) {
+        consumeChar();
+        if (!consumeRadixDigits(HexDigitClass)) return false;
+        if (!number::parseHexInteger(start + 2, _current, _token._value.emplace<unsigned long long>())) return fail(NumberOverflow);
+        _token._type = TokenType::Integer;
+        return true;
+    }
 
-    if (lead == '0' && isNumber()) throw CompilerError(UnexpectedCharacter, _point);
+    if (lead == '0' && (_lookaheadChar == 'b' || _lookaheadChar == 'B')) {
+        consumeChar();
+        if (!consumeRadixDigits(BinaryDigitClass)) return false;
+        if (!number::parseBinaryInteger(start + 2, _current, _token._value.emplace<unsigned long long>())) return fail(NumberOverflow);
+        _token._type = TokenType::Integer;
+        return true;
+    }
 
-    while(isNumber()) number += consumeChar();
+    if (lead == '0' && isNumber()) return fail(UnexpectedCharacter);
+
+    while(isNumber()) consumeChar();
+
+    bool hasFrac = false;
+    bool hasExp = false;
 
     if (_lookaheadChar == '.') {
-        number += consumeChar();
+        consumeChar();
         hasFrac = true;
 
-        if (isEoF()) throw CompilerError(UnexpectedEoF, _point);
-        if (!isNumber()) throw CompilerError(ExpectedADigit, _point);
+        if (isEoF()) return fail(UnexpectedEoF);
+        if (!isNumber()) return fail(ExpectedADigit);
 
-        while(isNumber()) number += consumeChar();
+        while(isNumber()) consumeChar();
     }
 
     if (_lookaheadChar == 'e' || _lookaheadChar == 'E') {
-        number += consumeChar();
+        consumeChar();
         hasExp = true;
-        if (isEoF()) throw CompilerError(UnexpectedEoF, _point);
-        if (_lookaheadChar == '+' || _lookaheadChar == '-') number += consumeChar();
-        if (!isNumber()) throw CompilerError(ExpectedADigit, _point);
-        while(isNumber()) number += consumeChar();
+        if (isEoF()) return fail(UnexpectedEoF);
+        if (_lookaheadChar == '+' || _lookaheadChar == '-') consumeChar();
+        if (!isNumber()) return fail(ExpectedADigit);
+        while(isNumber()) consumeChar();
     }
 
-    try {
-        if (hasExp || hasFrac) {   
-            _token._value = stod(number);
-            _token._type = TokenType::Float;
-        } else {
-            _token._value = stoull(number);
-            _token._type = TokenType::Integer;
-        }
-    } catch(out_of_range e) {
-        throw CompilerError(NumberOverflow, _point);
-    } catch(invalid_argument e) {
-        assert(false); // Numbers should be parsable by C++ std::stod() or std::stoull()
+    bool inRange;
+    if (hasExp || hasFrac) {
+        inRange = number::parseFloat(start, _current, _token._value.emplace<double>());
+        _token._type = TokenType::Float;
+    } else {
+        inRange = number::parseDecimalInteger(start, _current, _token._value.emplace<unsigned long long>());
+        _token._type = TokenType::Integer;
     }
+    if (!inRange) return fail(NumberOverflow);
+    return true;
+}
+
+// Consumes the digits after a 0x or 0b prefix, at least one is required.
+bool Lexer::TokenIterator::consumeRadixDigits(unsigned char digitClass) {
+    if (isEoF()) return fail(UnexpectedEoF);
+    if (!is(_lookaheadChar, static_cast<CharClass>(digitClass))) return fail(ExpectedADigit);
+    while(is(_lookaheadChar, static_cast<CharClass>(digitClass))) consumeChar();
+    return true;
 }
 
 void Lexer::TokenIterator::consumeOperator() {
-    string op;
-    op += _lookaheadChar;
-    auto found = operatorSymbols.find(op);
-    if (found == operatorSymbols.end()) {
-        assert(false); // Should have checked isOperatorChar() first.
-    }
+    unsigned int state = operatorTransition(0, _lookaheadChar);
+    assert(state != 0); // Should have checked isOperatorLeadChar() first.
     consumeChar();
-    do {
-        op += _lookaheadChar;
-        auto longerOpFound = operatorSymbols.find(op);
-        if (longerOpFound == operatorSymbols.end()) {
-            _token._type = found->second;
-            _token._value = 0ULL;
-            return;
-        }
-        found = longerOpFound;
+    while(unsigned int next = operatorTransition(state, _lookaheadChar)) {
+        state = next;
         consumeChar();
-    } while(true);
+    }
+    _token._type = operatorDFA.accepts[state];
+    _token._value = 0ULL;
 }
 
 void Lexer::TokenIterator::consumeNext() {
-    _token._sourceSpan.start = _point;
-    _token._stringSpan.start = _current;
+    const Char* start = _current;
+    _token._location = location();
+
+    bool lexed = true;
+    switch(leadKind(_lookaheadChar)) {
+        case LeadKind::EoF:
+            // A 0 character inside the code is not the end of it.
+            if (_current != _end) {
+                lexed = fail(UnexpectedCharacter);
+                break;
+            }
+            _token._type = TokenType::EoF;
+            _token._value = 0ULL;
+            break;
+        case LeadKind::Whitespace: consumeWhitespace(); break;
+        case LeadKind::Identifier: consumeIdentifier(); break;
+        case LeadKind::DoubleQuote: lexed = consumeDoubleQuotesString(); break;
+        case LeadKind::SingleQuote: lexed = consumeSingleQuotesString(); break;
+        case LeadKind::Number: lexed = consumeNumber(); break;
+        case LeadKind::Operator: consumeOperator(); break;
+        case LeadKind::Unexpected: lexed = fail(UnexpectedCharacter); break;
+        case LeadKind::Unicode: lexed = consumeUnicode(); break;
+    }
+
+    // Strings and whitespace are skipped without decoding, a token may have run over invalid UTF-8.
+    if (lexed && _current > _invalidUtf8) lexed = fail(InvalidUtf8, _invalidUtf8);
 
-    if (isEoF()) {
-        _token._type = TokenType::EoF;
+    if (!lexed) {
+        // The error was reported, skip the text that failed and at least one whole character.
+        if (_current == start) {
+            consumeChar();
+            while ((_lookaheadChar & 0xC0) == 0x80) consumeChar();
+        }
+        _token._type = TokenType::Error;
         _token._value = 0ULL;
-    } else if (isWhitespace()) {
-        consumeWhitespace();
-    } else if (isIdentifierLeadChar()) {
-        consumeIdentifier();
-    } else if (isDoubleQuoteChar()) {
-        consumeDoubleQuotesString();
-    } else if (isSingleQuoteChar()) {
-        consumeSingleQuotesString();
-    } else if (isNumber()) {
-        consumeNumber();
-    } else if (isOperatorLeadChar()) {
-        consumeOperator();
-    } else {
-        throw CompilerError(UnexpectedCharacter, _point);
+
+        // Recovering past invalid UTF-8, validate the rest of the code.
+        if (_current > _invalidUtf8) _invalidUtf8 = scan::findInvalidUtf8(_current, _end);
     }
 
-    _token._sourceSpan.end = _point;
-    _token._stringSpan.end = _current;
+    _token._length = static_cast<unsigned int>(_current - start);
 }
 
 bool Lexer::TokenIterator::operator== (const Lexer::TokenIterator& other) {
@@ -383,13 +493,13 @@ ostream& operator << (ostream& out, Lexer::Token& token) {
     out << name(token.type()) << " (" << token.span() << ") ";
     switch(token.type()) {
         case TokenType::Identifier:
-            out << token.value<string>() << " ";
+            out << token.value<Atom>() << " ";
             break;
         case TokenType::SingleQuotesString:
-            out << '\'' << token.value<string>() << '\'' << " ";
+            out << '\'' << token.value<string_view>() << '\'' << " ";
             break;
         case TokenType::DoubleQuotesString:
-            out << '"' << token.value<string>() << '"' << " ";
+            out << '"' << token.value<string_view>() << '"' << " ";
             break;
         case TokenType::Integer:
             out << token.value<unsigned long long int>() << " ";
@@ -403,15 +513,3 @@ ostream& operator << (ostream& out, Lexer::Token& token) {
 
     return out;
 }
-
-ostream& operator<< (ostream& out, const SourcePoint& point) {
-    return out << point.line << ":" << point.column;
-}
-
-ostream& operator<< (ostream& out, const SourceSpan& span) {
-    if (span.start == span.end) {
-        return out << span.start;
-    } else {
-        return out << span.start << "-" << span.end;
-    }
-}
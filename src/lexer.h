@@ -2,15 +2,20 @@
 #define RVM_LEXER_H
 
 #include <string>
+#include <string_view>
 #include <variant>
 #include "source.h"
+#include "atom.h"
+#include "diagnostics.h"
+#include "arena.h"
 
 namespace rvm {
-    enum class TokenType : unsigned int {
+    enum class TokenType : unsigned char {
         EoF = 0,
+        Error, // Text that failed to lex, only produced when reporting to a DiagnosticEngine
 
         // Complex expressions
-        Identifier, // a-zA-Z_ and any code >127 followed by a-zA-Z_0-9 and any code >127
+        Identifier, // a-zA-Z_ and Unicode XID_Start followed by a-zA-Z0-9_ and Unicode XID_Continue
         Integer, // uint8, uint16, uint32, uint64
         Float, // float32, float64
         Whitespace, // \r\n, white space, tabulation
@@ -93,37 +98,51 @@ namespace rvm {
 
     std::string name(TokenType type);
 
-    extern const std::map<std::string, TokenType> keywords;
-    extern const std::map<std::string, TokenType> operatorSymbols;
+    class TokenBuffer;
 
     class Lexer {
-        std::string _code;
+        const SourceBuffer& _source;
+        DiagnosticEngine* _diagnostics;
+        Arena _strings;
 
     public:
-        Lexer(std::string code): _code(code) {}
+        /// The Lexer does not copy the source, tokens reference it while they are in use.
+        /// Errors throw a CompilerError, unless diagnostics is given: then they are reported there,
+        /// the text is returned as a TokenType::Error token and lexing continues after it.
+        Lexer(const SourceBuffer& source, DiagnosticEngine* diagnostics = nullptr): _source(source), _diagnostics(diagnostics) {}
 
         class TokenIterator;
         class Token;
 
+        /// Starts lexing at location, which must be the start of a token or of whitespace.
+        TokenIterator at(SourceLocation location);
+
+        /// Holds the decoded text of string literals with escape sequences, take it to keep their tokens' values.
+        Arena& strings() { return _strings; }
+
+        /// Tokens do not own memory, identifiers hold an interned Atom and string literals are views into the source,
+        /// or into the Lexer's strings Arena when they had escape sequences to decode.
+        /// The position is a compact offset and length, resolve it with the SourceBuffer.
         class Token {
             TokenType _type;
-            std::variant<unsigned long long, double, std::string> _value;
-
-            SourceSpan _sourceSpan;
-            StringSpan _stringSpan;
+            SourceLocation _location;
+            unsigned int _length;
+            std::variant<unsigned long long, double, Atom, std::string_view> _value;
 
         public:
             friend class TokenIterator;
+            friend class rvm::TokenBuffer;
 
-            Token() : _type(TokenType::EoF), _value(0ULL) {}
+            Token() : _type(TokenType::EoF), _length(0), _value(0ULL) {}
 
             const TokenType& type() const { return _type; }
 
             template<typename T>
             T value() { return std::get<T>(_value); }
 
-            const SourceSpan span() const { return _sourceSpan; }
-            std::string code() const { return _stringSpan.toString(); }
+            SourceLocation location() const { return _location; }
+            const SourceSpan span() const { return { _location, SourceLocation(_location.offset + _length) }; }
+            std::string_view code(const SourceBuffer& source) const { return source.code(span()); }
             
             bool operator == (const TokenType type) const { return _type == type; }
             bool operator != (const TokenType type) const { return _type != type; }
@@ -132,17 +151,20 @@ namespace rvm {
         };
 
         class TokenIterator {
-            StringIterator _current;
-            StringIterator _end;
+            const Char* _begin;
+            const Char* _current;
+            const Char* _end;
+            const Char* _invalidUtf8;
+            Arena* _strings;
+            DiagnosticEngine* _diagnostics;
 
             Token _token;
-            SourcePoint _point;
             Char _lookaheadChar;
 
         public:
             typedef std::input_iterator_tag iterator_category;
 
-            TokenIterator(StringIterator begin, StringIterator end);
+            TokenIterator(const SourceBuffer& source, const Char* current, Arena* strings, DiagnosticEngine* diagnostics = nullptr);
 
             TokenIterator& operator++();
             TokenIterator operator++(int);
@@ -153,30 +175,32 @@ namespace rvm {
             const Token& operator*() const { return _token; }
             const Token* operator->() const { return &_token; }
         private:
+            SourceLocation location() const { return SourceLocation(static_cast<unsigned int>(_current - _begin)); }
+            bool fail(ErrorCode code);
+            bool fail(ErrorCode code, const Char* position);
             Char consumeChar();
+            void advance(const Char* position);
             void consumeIdentifier();
+            bool consumeUnicode();
             void consumeSingleCharToken(const Char& c, const TokenType& type);
             void consumeWhitespace();
-            void consumeString();
-            void consumeDoubleQuotesString();
-            void consumeSingleQuotesString();
-            void consumeNumber();
+            bool consumeString();
+            bool consumeEscapeSequence();
+            void skipStringRest(Char terminator);
+            bool consumeDoubleQuotesString();
+            bool consumeSingleQuotesString();
+            bool consumeNumber();
+            bool consumeRadixDigits(unsigned char digitClass);
             void consumeOperator();
             void consumeNext();
 
+            // Character classification is table driven, see lexertables.h.
             bool isEoF() { return _lookaheadChar == 0; }
-            bool isChar() { return (_lookaheadChar >= 'a' && _lookaheadChar <= 'z') || (_lookaheadChar >= 'A' && _lookaheadChar <= 'Z') || (_lookaheadChar > 127); }
-            bool isNumber() { return _lookaheadChar >= '0' && _lookaheadChar <= '9'; }        
-            bool isWhitespace() { return _lookaheadChar == ' ' || _lookaheadChar == '\t' || _lookaheadChar == '\n' || _lookaheadChar == '\r'; }
-            bool isIdentifierLeadChar() { return isChar() || _lookaheadChar == '_'; }
-            bool isOperatorLeadChar() {
-                std::string op;
-                op += _lookaheadChar;
-                return operatorSymbols.find(op) != operatorSymbols.end();
-            }
-            bool isIdentifierTailChar() { return isIdentifierLeadChar() || isNumber(); }
-            bool isDoubleQuoteChar() { return _lookaheadChar == '"'; }
-            bool isSingleQuoteChar() { return _lookaheadChar == '\''; }
+            bool isNumber();
+            bool isWhitespace();
+            bool isIdentifierLeadChar();
+            bool isOperatorLeadChar();
+            bool isIdentifierTailChar();
         };
 
         TokenIterator begin();
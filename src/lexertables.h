@@ -0,0 +1,269 @@
+#ifndef RVM_LEXERTABLES_H
+#define RVM_LEXERTABLES_H
+
+#include <string_view>
+#include "lexer.h"
+
+// Compile time tables used by the Lexer hot loop.
+// Everything here is constexpr, so recognizing a character, an operator or a keyword
+// is a handful of table loads, and consuming a token never allocates.
+namespace rvm {
+    namespace lexer {
+        struct SymbolDefinition {
+            std::string_view symbol;
+            TokenType type;
+        };
+
+        constexpr SymbolDefinition keywords[] {
+            { "declare", TokenType::DeclareKeyword },
+            { "function", TokenType::FunctionKeyword },
+            { "void", TokenType::VoidKeyword },
+            { "never", TokenType::NeverKeyword },
+            { "bool", TokenType::BoolKeyword },
+            { "int", TokenType::IntKeyword },
+            { "float", TokenType::FloatKeyword },
+            { "string", TokenType::StringKeyword },
+            { "var", TokenType::VarKeyword },
+            { "const", TokenType::ConstKeyword },
+            { "return", TokenType::ReturnKeyword },
+        };
+
+        constexpr SymbolDefinition operatorSymbols[] {
+            { "(", TokenType::OpenParenthesis },
+            { ")", TokenType::CloseParenthesis },
+            { "[", TokenType::LeftBracket },
+            { "]", TokenType::RightBracket },
+            { "{", TokenType::LeftBrace },
+            { "}", TokenType::RightBrace },
+            { ":", TokenType::Colon },
+            { ";", TokenType::Semicolon },
+            { ",", TokenType::Comma },
+            { ".", TokenType::Dot },
+
+            { "=", TokenType::Assignment },
+            { "==", TokenType::Equal },
+            { "<", TokenType::Less },
+            { "<=", TokenType::LessOrEqual },
+            { ">", TokenType::Greater },
+            { ">=", TokenType::GreaterOrEqual },
+            { "!=", TokenType::NotEqual },
+
+            { "+", TokenType::Plus },
+            { "-", TokenType::Minus },
+            { "*", TokenType::Multiply },
+            { "/", TokenType::Divide },
+            { "%", TokenType::Reminder },
+
+            { "&", TokenType::BitwiseAnd },
+            { "|", TokenType::BitwiseOr },
+            { "^", TokenType::BitwiseXOr },
+
+            { "?", TokenType::Question },
+            { "~", TokenType::BitComplement },
+
+            { "++", TokenType::Increment },
+            { "--", TokenType::Decrement },
+
+            { "&&", TokenType::ConditionalAnd },
+            { "||", TokenType::ConditionalOr },
+            { "!", TokenType::ConditionalNot },
+
+            { "<<", TokenType::LeftShift },
+            { ">>", TokenType::RightShift },
+
+            { "+=", TokenType::AdditionAssignment },
+            { "-=", TokenType::SubtractionAssignment },
+            { "*=", TokenType::MultiplicationAssignment },
+            { "/=", TokenType::DivisionAssignment },
+            { "%=", TokenType::ReminderAssignment },
+
+            { "&=", TokenType::BitAndAssignment },
+            { "|=", TokenType::BitOrAssignment },
+            { "^=", TokenType::BitXOrAssignment },
+
+            { "<<=", TokenType::LeftShiftAssignment },
+            { ">>=", TokenType::RightShiftAssignment },
+
+            { "->", TokenType::PointerMemberAccess },
+            { "??", TokenType::NullCoalescing },
+            { "=>", TokenType::LambdaOperator },
+        };
+
+        /// Character classes, a character may belong to several.
+        enum CharClass : unsigned char {
+            WhitespaceClass = 1 << 0, // \r\n, white space, tabulation
+            IdentifierLeadClass = 1 << 1, // a-zA-Z_, other identifier characters are outside ASCII
+            DigitClass = 1 << 2, // 0-9
+            OperatorLeadClass = 1 << 3, // first character of any operator symbol
+            HexDigitClass = 1 << 4, // 0-9a-fA-F
+            BinaryDigitClass = 1 << 5, // 0-1
+
+            IdentifierTailClass = IdentifierLeadClass | DigitClass,
+        };
+
+        /// Decides which consume method handles a token by its first character.
+        enum class LeadKind : unsigned char {
+            Unexpected,
+            EoF,
+            Whitespace,
+            Identifier,
+            Number,
+            DoubleQuote,
+            SingleQuote,
+            Operator,
+            Unicode, // Lead byte of a UTF-8 sequence, decoded to classify the character
+        };
+
+        struct CharTable {
+            unsigned char classes[256];
+            LeadKind leads[256];
+        };
+
+        constexpr CharTable makeCharTable() {
+            CharTable table {};
+            for (unsigned int c = 0; c < 256; c++) {
+                unsigned char classes = 0;
+                if (c == ' ' || c == '\t' || c == '\n' || c == '\r') classes |= WhitespaceClass;
+                if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_') classes |= IdentifierLeadClass;
+                if (c >= '0' && c <= '9') classes |= DigitClass;
+                if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F')) classes |= HexDigitClass;
+                if (c == '0' || c == '1') classes |= BinaryDigitClass;
+                for (auto& op : operatorSymbols) {
+                    if (static_cast<unsigned char>(op.symbol[0]) == c) classes |= OperatorLeadClass;
+                }
+                table.classes[c] = classes;
+
+                if (c == 0) table.leads[c] = LeadKind::EoF;
+                else if (c > 127) table.leads[c] = LeadKind::Unicode;
+                else if (classes & WhitespaceClass) table.leads[c] = LeadKind::Whitespace;
+                else if (classes & IdentifierLeadClass) table.leads[c] = LeadKind::Identifier;
+                else if (c == '"') table.leads[c] = LeadKind::DoubleQuote;
+                else if (c == '\'') table.leads[c] = LeadKind::SingleQuote;
+                else if (classes & DigitClass) table.leads[c] = LeadKind::Number;
+                else if (classes & OperatorLeadClass) table.leads[c] = LeadKind::Operator;
+                else table.leads[c] = LeadKind::Unexpected;
+            }
+            return table;
+        }
+
+        constexpr CharTable charTable = makeCharTable();
+
+        inline bool is(Char c, CharClass charClass) {
+            return (charTable.classes[static_cast<unsigned char>(c)] & charClass) != 0;
+        }
+
+        inline LeadKind leadKind(Char c) {
+            return charTable.leads[static_cast<unsigned char>(c)];
+        }
+
+        /// Maximal munch DFA over operatorSymbols.
+        /// State 0 is the start state and doubles as the dead state, since no transition leads back to it.
+        /// Characters are first mapped to a dense column so the transition table stays small.
+        const unsigned int operatorMaxStates = 64;
+        const unsigned int operatorMaxColumns = 32;
+
+        struct OperatorDFA {
+            unsigned char columns[256];
+            unsigned char transitions[operatorMaxStates][operatorMaxColumns];
+            TokenType accepts[operatorMaxStates];
+            unsigned int stateCount;
+            unsigned int columnCount;
+        };
+
+        constexpr OperatorDFA makeOperatorDFA() {
+            OperatorDFA dfa {};
+            dfa.stateCount = 1;
+            dfa.columnCount = 1; // Column 0 is every character that is not part of an operator.
+
+            for (auto& op : operatorSymbols) {
+                unsigned int state = 0;
+                for (char c : op.symbol) {
+                    unsigned char index = static_cast<unsigned char>(c);
+                    if (dfa.columns[index] == 0) dfa.columns[index] = static_cast<unsigned char>(dfa.columnCount++);
+                    unsigned char column = dfa.columns[index];
+                    if (dfa.transitions[state][column] == 0) dfa.transitions[state][column] = static_cast<unsigned char>(dfa.stateCount++);
+                    state = dfa.transitions[state][column];
+                }
+                dfa.accepts[state] = op.type;
+            }
+            return dfa;
+        }
+
+        constexpr OperatorDFA operatorDFA = makeOperatorDFA();
+
+        constexpr bool everyOperatorStateAccepts() {
+            for (unsigned int state = 1; state < operatorDFA.stateCount; state++) {
+                if (operatorDFA.accepts[state] == TokenType::EoF) return false;
+            }
+            return true;
+        }
+
+        // Every prefix of an operator is an operator itself, so maximal munch never has to backtrack.
+        static_assert(everyOperatorStateAccepts(), "Operator symbol prefixes must be operators.");
+
+        inline unsigned int operatorTransition(unsigned int state, Char c) {
+            return operatorDFA.transitions[state][operatorDFA.columns[static_cast<unsigned char>(c)]];
+        }
+
+        /// Perfect hash over keywords, hashing the first and last character and the length.
+        /// The multipliers are searched at compile time for a collision free table.
+        const unsigned int keywordTableSize = 16;
+
+        struct KeywordHash {
+            unsigned int first, last;
+        };
+
+        constexpr unsigned int keywordHash(KeywordHash hash, std::string_view text) {
+            return ((static_cast<unsigned char>(text.front()) * hash.first)
+                ^ (static_cast<unsigned char>(text.back()) * hash.last)
+                ^ static_cast<unsigned int>(text.size())) & (keywordTableSize - 1);
+        }
+
+        constexpr KeywordHash findKeywordHash() {
+            for (unsigned int first = 1; first < 256; first++) {
+                for (unsigned int last = 0; last < 256; last++) {
+                    bool used[keywordTableSize] {};
+                    bool collision = false;
+                    for (auto& keyword : keywords) {
+                        unsigned int slot = keywordHash({ first, last }, keyword.symbol);
+                        if (used[slot]) collision = true;
+                        used[slot] = true;
+                    }
+                    if (!collision) return { first, last };
+                }
+            }
+            return { 0, 0 };
+        }
+
+        constexpr KeywordHash keywordHashSeed = findKeywordHash();
+        static_assert(keywordHashSeed.first != 0, "No perfect hash found for the keywords.");
+
+        struct KeywordTable {
+            SymbolDefinition slots[keywordTableSize];
+            unsigned int minLength, maxLength;
+        };
+
+        constexpr KeywordTable makeKeywordTable() {
+            KeywordTable table {};
+            table.minLength = ~0U;
+            for (auto& slot : table.slots) slot = { std::string_view(), TokenType::Identifier };
+            for (auto& keyword : keywords) {
+                table.slots[keywordHash(keywordHashSeed, keyword.symbol)] = keyword;
+                if (keyword.symbol.size() < table.minLength) table.minLength = static_cast<unsigned int>(keyword.symbol.size());
+                if (keyword.symbol.size() > table.maxLength) table.maxLength = static_cast<unsigned int>(keyword.symbol.size());
+            }
+            return table;
+        }
+
+        constexpr KeywordTable keywordTable = makeKeywordTable();
+
+        /// Returns the keyword TokenType for identifier, or TokenType::Identifier if it is not a keyword.
+        inline TokenType keywordType(std::string_view identifier) {
+            if (identifier.size() < keywordTable.minLength || identifier.size() > keywordTable.maxLength) return TokenType::Identifier;
+            const SymbolDefinition& slot = keywordTable.slots[keywordHash(keywordHashSeed, identifier)];
+            return slot.symbol == identifier ? slot.type : TokenType::Identifier;
+        }
+    };
+};
+
+#endif
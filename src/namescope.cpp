@@ -3,29 +3,64 @@
 using namespace std;
 using namespace rvm;
 
-Symbol* rvm::NameScope::selfLookup(string name) {
-    auto kvp = _symbols.find(name);
-    if (kvp == _symbols.end()) return nullptr;
-    return kvp->second.get();
+namespace {
+    // Atom ids are dense, a multiplicative hash spreads neighbours over the table.
+    inline size_t slotOf(unsigned int name, size_t mask) {
+        unsigned int hash = name * 0x9E3779B9U;
+        return (hash ^ (hash >> 16)) & mask;
+    }
 }
 
-Symbol* rvm::NameScope::create(string name) {
+Symbol* rvm::NameScope::selfLookup(Atom name) const {
+    if (_slots.empty()) return nullptr;
+    size_t mask = _slots.size() - 1;
+    for (size_t slot = slotOf(name.id(), mask); ; slot = (slot + 1) & mask) {
+        const Slot& entry = _slots[slot];
+        if (entry.symbol == nullptr) return nullptr;
+        if (entry.name == name.id()) return entry.symbol;
+    }
+}
+
+Symbol* rvm::NameScope::create(Atom name) {
     auto symbolPtr = selfLookup(name);
     if (symbolPtr != nullptr) return symbolPtr;
 
-    auto symbol = std::make_unique<Symbol>(name);
-    symbolPtr = symbol.get();
-    _symbols[name] = std::move(symbol);
+    // At most half full, so probes stay short and always reach an empty slot.
+    if ((_symbols.size() + 1) * 2 > _slots.size()) grow();
+    _symbols.push_back(make_unique<Symbol>(name));
+    symbolPtr = _symbols.back().get();
+
+    size_t mask = _slots.size() - 1;
+    size_t slot = slotOf(name.id(), mask);
+    while (_slots[slot].symbol != nullptr) slot = (slot + 1) & mask;
+    _slots[slot] = { name.id(), symbolPtr };
     return symbolPtr;
 }
 
-Symbol* rvm::NameScope::lookup(std::string name) {
-    auto selfSymbol = selfLookup(name);
-    if (selfSymbol != nullptr) return selfSymbol;
-    if (_parent == nullptr) return nullptr;
-    return _parent->lookup(name);
+void rvm::NameScope::grow() {
+    vector<Slot> slots(_slots.empty() ? 8 : _slots.size() * 2, Slot { 0, nullptr });
+    size_t mask = slots.size() - 1;
+    for (auto& symbol : _symbols) {
+        size_t slot = slotOf(symbol->name().id(), mask);
+        while (slots[slot].symbol != nullptr) slot = (slot + 1) & mask;
+        slots[slot] = { symbol->name().id(), symbol.get() };
+    }
+    _slots = move(slots);
 }
 
-void rvm::NameScope::addSymbolDeclaration(std::string name, rvm::ast::ModuleMember* declaration) {
+Symbol* rvm::NameScope::lookup(Atom name) const {
+    for (const NameScope* scope = this; scope != nullptr; scope = scope->_parent) {
+        auto symbol = scope->selfLookup(name);
+        if (symbol != nullptr) return symbol;
+    }
+    return nullptr;
+}
+
+void rvm::NameScope::addSymbolDeclaration(Atom name, rvm::ast::NodeId declaration) {
     create(name)->add(declaration);
 }
+
+void rvm::NameScope::removeSymbolDeclaration(Atom name, rvm::ast::NodeId declaration) {
+    auto symbol = selfLookup(name);
+    if (symbol != nullptr) symbol->remove(declaration);
+}
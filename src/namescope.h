@@ -1,33 +1,54 @@
 #ifndef RVM_NAMESCOPE_H
 #define RVM_NAMESCOPE_H
 
-#include <string>
 #include <vector>
+#include <memory>
+#include "atom.h"
 #include "ast.h"
 #include "types.h"
 #include "symbol.h"
 
 namespace rvm {
+    /// The Symbols declared in a scope, looked up by name here and up the chain of parent scopes.
+    /// Names are Atoms, so resolving one hashes and compares integers and never allocates.
+    /// Symbols are found in an open addressing table with linear probing, a scope without names allocates nothing.
     class NameScope {
+        struct Slot {
+            unsigned int name;
+            // nullptr for empty slots.
+            Symbol* symbol;
+        };
+
         NameScope* _parent;
-        std::map<std::string, std::unique_ptr<Symbol> > _symbols;
+        std::vector<Slot> _slots;
+        std::vector<std::unique_ptr<Symbol> > _symbols;
 
         /// Looks up a Symbol by name in this NameScope.
         /// Does not search recursively the parent NameScope.
-        Symbol* selfLookup(std::string name);
+        Symbol* selfLookup(Atom name) const;
 
         /// Creates a Symbol in this NameScope for name.
-        Symbol* create(std::string name);
+        Symbol* create(Atom name);
+
+        /// Doubles the table and inserts the symbols again.
+        void grow();
 
     public:
         NameScope() : _parent(nullptr) {}
         NameScope(NameScope* parent) : _parent(parent) {}
 
-        /// Looks up a Symbol by name in this NameScope and recursively up the parents chain.
-        Symbol* lookup(std::string name);
+        /// Looks up a Symbol by name in this NameScope and up the parents chain.
+        Symbol* lookup(Atom name) const;
 
         /// Add the declaration to a Symbol with name in this NameScope.
-        void addSymbolDeclaration(std::string name, rvm::ast::ModuleMember* declaration);
+        void addSymbolDeclaration(Atom name, rvm::ast::NodeId declaration);
+
+        /// Removes the declaration from the Symbol with name in this NameScope.
+        /// The Symbol is kept without it, so types referencing it stay valid, a Symbol without declarations names nothing.
+        void removeSymbolDeclaration(Atom name, rvm::ast::NodeId declaration);
+
+        /// The number of Symbols declared in this NameScope.
+        size_t size() const { return _symbols.size(); }
     };
 }
 
@@ -0,0 +1,227 @@
+#include <cassert>
+#include <cerrno>
+#include <cfloat>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+#include "number.h"
+#include "powersoften.h"
+
+using namespace std;
+using namespace rvm;
+using namespace rvm::number;
+
+namespace {
+    // 19 decimal digits always fit in 64 bits.
+    const int maxMantissaDigits = 19;
+
+    inline unsigned int digit(Char c) {
+        return static_cast<unsigned int>(c - '0');
+    }
+
+    inline unsigned int hexDigit(Char c) {
+        if (c >= '0' && c <= '9') return static_cast<unsigned int>(c - '0');
+        return static_cast<unsigned int>((c | 0x20) - 'a' + 10);
+    }
+
+    inline int countLeadingZeros(unsigned long long value) {
+#if defined(_MSC_VER) && !defined(__clang__)
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return 63 - static_cast<int>(index);
+#else
+        return __builtin_clzll(value);
+#endif
+    }
+
+    // The full 128 bit product of a and b.
+    inline void multiply(unsigned long long a, unsigned long long b, unsigned long long& high, unsigned long long& low) {
+#if defined(_MSC_VER) && !defined(__clang__)
+        low = _umul128(a, b, &high);
+#else
+        unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+        high = static_cast<unsigned long long>(product >> 64);
+        low = static_cast<unsigned long long>(product);
+#endif
+    }
+
+    inline double fromBits(unsigned long long bits) {
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    const double exactPowersOfTen[] {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+
+    // Clinger's fast path, exact when both the mantissa and the power of ten are exact doubles.
+    // It needs double arithmetic without extended precision, which rules out x87.
+    inline bool clinger(unsigned long long mantissa, int exponent10, double& value) {
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+        if (mantissa > (1ULL << 53) || exponent10 < -22 || exponent10 > 22) return false;
+        value = static_cast<double>(mantissa);
+        value = exponent10 < 0 ? value / exactPowersOfTen[-exponent10] : value * exactPowersOfTen[exponent10];
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Eisel-Lemire: mantissa * 10^exponent10 rounded to nearest even, for normal finite results.
+    // Returns false when the 128 bit approximation can not decide the rounding, or the result
+    // would be subnormal, infinite or out of the table range.
+    bool eiselLemire(unsigned long long mantissa, int exponent10, double& value) {
+        if (mantissa == 0) {
+            value = 0.0;
+            return true;
+        }
+        if (exponent10 < minPowerOfTen || exponent10 > maxPowerOfTen) return false;
+
+        const PowerOfTen& power = powersOfTen[exponent10 - minPowerOfTen];
+        int leadingZeros = countLeadingZeros(mantissa);
+        mantissa <<= leadingZeros;
+
+        // floor(log2(10) * exponent10) + 64 + exponent bias, 217706 / 2^16 approximates log2(10).
+        long long exponent2 = ((217706LL * exponent10) >> 16) + 64 + 1023 - leadingZeros;
+
+        unsigned long long high, low;
+        multiply(mantissa, power.high, high, low);
+
+        // The low 9 bits are all ones, the truncated part of the power could carry into the result.
+        if ((high & 0x1FF) == 0x1FF && low + mantissa < mantissa) {
+            unsigned long long wideHigh, wideLow;
+            multiply(mantissa, power.low, wideHigh, wideLow);
+            unsigned long long mergedHigh = high, mergedLow = low + wideHigh;
+            if (mergedLow < low) mergedHigh++;
+            if ((mergedHigh & 0x1FF) == 0x1FF && mergedLow + 1 == 0 && wideLow + mantissa < mantissa) return false;
+            high = mergedHigh;
+            low = mergedLow;
+        }
+
+        // Keep 54 bits, one more than the double mantissa for rounding.
+        unsigned long long upperBit = high >> 63;
+        unsigned long long bits = high >> (upperBit + 9);
+        exponent2 -= static_cast<long long>(1 ^ upperBit);
+
+        // Exactly halfway between two doubles, the approximation can not tell which way to round.
+        if (low == 0 && (high & 0x1FF) == 0 && (bits & 3) == 1) return false;
+
+        bits += bits & 1;
+        bits >>= 1;
+        if (bits >> 53) {
+            bits >>= 1;
+            exponent2++;
+        }
+
+        if (exponent2 <= 0 || exponent2 >= 0x7FF) return false;
+        value = fromBits(static_cast<unsigned long long>(exponent2) << 52 | (bits & 0x000FFFFFFFFFFFFFULL));
+        return true;
+    }
+
+    // The rare cases, subnormal or out of range results and undecided rounding.
+    bool parseFloatSlow(const Char* begin, const Char* end, double& value) {
+        char* parsed;
+        errno = 0;
+        value = strtod(begin, &parsed);
+        assert(parsed == end); // The literal syntax is a subset of strtod's.
+        (void)end;
+        return errno != ERANGE;
+    }
+}
+
+bool rvm::number::parseDecimalInteger(const Char* begin, const Char* end, unsigned long long& value) {
+    unsigned long long result = 0;
+    if (end - begin <= maxMantissaDigits) {
+        for (const Char* c = begin; c != end; c++) result = result * 10 + digit(*c);
+    } else {
+        for (const Char* c = begin; c != end; c++) {
+            unsigned int d = digit(*c);
+            if (result > (ULLONG_MAX - d) / 10) return false;
+            result = result * 10 + d;
+        }
+    }
+    value = result;
+    return true;
+}
+
+bool rvm::number::parseHexInteger(const Char* begin, const Char* end, unsigned long long& value) {
+    while (begin != end && *begin == '0') begin++;
+    if (end - begin > 16) return false;
+    unsigned long long result = 0;
+    for (const Char* c = begin; c != end; c++) result = result << 4 | hexDigit(*c);
+    value = result;
+    return true;
+}
+
+bool rvm::number::parseBinaryInteger(const Char* begin, const Char* end, unsigned long long& value) {
+    while (begin != end && *begin == '0') begin++;
+    if (end - begin > 64) return false;
+    unsigned long long result = 0;
+    for (const Char* c = begin; c != end; c++) result = result << 1 | digit(*c);
+    value = result;
+    return true;
+}
+
+bool rvm::number::parseFloat(const Char* begin, const Char* end, double& value) {
+    // Collect up to 19 significant digits, the rest only move the decimal exponent.
+    unsigned long long mantissa = 0;
+    int digits = 0;
+    int exponent10 = 0;
+    bool truncated = false;
+
+    const Char* c = begin;
+    for (; c != end && *c >= '0' && *c <= '9'; c++) {
+        if (digits < maxMantissaDigits) {
+            mantissa = mantissa * 10 + digit(*c);
+            if (mantissa != 0) digits++;
+        } else {
+            exponent10++;
+            truncated |= *c != '0';
+        }
+    }
+
+    if (c != end && *c == '.') {
+        for (c++; c != end && *c >= '0' && *c <= '9'; c++) {
+            if (digits < maxMantissaDigits) {
+                mantissa = mantissa * 10 + digit(*c);
+                if (mantissa != 0) digits++;
+                exponent10--;
+            } else {
+                truncated |= *c != '0';
+            }
+        }
+    }
+
+    if (c != end && (*c == 'e' || *c == 'E')) {
+        c++;
+        bool negative = *c == '-';
+        if (*c == '+' || *c == '-') c++;
+        // Large enough to underflow or overflow any mantissa, small enough not to overflow int.
+        int exponent = 0;
+        for (; c != end; c++) {
+            if (exponent < 100000) exponent = exponent * 10 + static_cast<int>(digit(*c));
+        }
+        exponent10 += negative ? -exponent : exponent;
+    }
+
+    if (!truncated) {
+        if (clinger(mantissa, exponent10, value)) return true;
+        if (eiselLemire(mantissa, exponent10, value)) return true;
+    } else {
+        // The exact value is between mantissa and mantissa + 1, both have to round the same way.
+        double lower, upper;
+        if (eiselLemire(mantissa, exponent10, lower) && eiselLemire(mantissa + 1, exponent10, upper) && lower == upper) {
+            value = lower;
+            return true;
+        }
+    }
+
+    return parseFloatSlow(begin, end, value);
+}
@@ -0,0 +1,28 @@
+#ifndef RVM_NUMBER_H
+#define RVM_NUMBER_H
+
+#include "source.h"
+
+// Conversions of numeric literals scanned by the Lexer, without allocating.
+// Integers are accumulated with explicit overflow checks, floats are converted with the
+// Clinger fast path or the Eisel-Lemire algorithm, falling back to std::strtod on the rare
+// inputs they can not round with certainty, so results are always those of std::strtod.
+namespace rvm {
+    namespace number {
+        /// Parses the decimal digits in [begin, end), returns false if the value does not fit in 64 bits.
+        bool parseDecimalInteger(const Char* begin, const Char* end, unsigned long long& value);
+
+        /// Parses the hexadecimal digits in [begin, end), returns false if the value does not fit in 64 bits.
+        bool parseHexInteger(const Char* begin, const Char* end, unsigned long long& value);
+
+        /// Parses the binary digits in [begin, end), returns false if the value does not fit in 64 bits.
+        bool parseBinaryInteger(const Char* begin, const Char* end, unsigned long long& value);
+
+        /// Parses a decimal float literal in [begin, end), digits [. digits] [(e|E) [+|-] digits].
+        /// The literal must be followed by a character that can not continue it, as in SourceBuffer code.
+        /// Returns false if the value is out of range, where std::strtod reports ERANGE.
+        bool parseFloat(const Char* begin, const Char* end, double& value);
+    };
+};
+
+#endif
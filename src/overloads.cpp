@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <cstdint>
+
+#include "overloads.h"
+
+using namespace std;
+using namespace rvm;
+using namespace rvm::type;
+
+namespace {
+    // Interned types have unique ids, the others share id 0 and are told apart by pointer in the bucket.
+    unsigned long long overloadKey(TypeList argumentTypes) {
+        unsigned long long arity = argumentTypes.size();
+        return arity << 32 | (arity == 0 ? 0 : argumentTypes[0]->id());
+    }
+
+    bool sameTypes(TypeList a, TypeList b) {
+        return a.size() == b.size() && equal(a.begin(), a.end(), b.begin());
+    }
+
+    size_t hashCall(const Type* callee, TypeList argumentTypes) {
+        unsigned long long hash = 0xCBF29CE484222325ULL ^ reinterpret_cast<uintptr_t>(callee);
+        for (auto argument : argumentTypes) hash = (hash ^ reinterpret_cast<uintptr_t>(argument)) * 0x100000001B3ULL;
+        hash ^= argumentTypes.size();
+        hash *= 0x9E3779B97F4A7C15ULL;
+        return static_cast<size_t>(hash ^ (hash >> 32));
+    }
+}
+
+void rvm::type::OverloadSet::add(SignatureType* signature) {
+    auto& bucket = _index[overloadKey(signature->argumentTypes())];
+    if (find(bucket.begin(), bucket.end(), signature) != bucket.end()) return;
+    bucket.push_back(signature);
+    _signatures.push_back(signature);
+}
+
+SignatureType* rvm::type::OverloadSet::resolve(TypeList argumentTypes) const {
+    auto bucket = _index.find(overloadKey(argumentTypes));
+    if (bucket == _index.end()) return nullptr;
+    for (auto signature : bucket->second) {
+        if (sameTypes(signature->argumentTypes(), argumentTypes)) return signature;
+    }
+    return nullptr;
+}
+
+SignatureType* rvm::type::OverloadCache::resolve(const Type* callee, TypeList argumentTypes) {
+    // Kept at most half full, so probes stay short and always reach an empty slot.
+    if ((_size + 1) * 2 > _entries.size()) grow();
+
+    size_t mask = _entries.size() - 1;
+    size_t slot = hashCall(callee, argumentTypes) & mask;
+    for (; _entries[slot].callee != nullptr; slot = (slot + 1) & mask) {
+        const Entry& entry = _entries[slot];
+        if (entry.callee == callee && sameTypes(TypeList(entry.arguments, entry.count), argumentTypes)) return entry.signature;
+    }
+
+    Type** arguments = static_cast<Type**>(_arena.allocate(sizeof(Type*) * max<size_t>(argumentTypes.size(), 1), alignof(Type*)));
+    copy(argumentTypes.begin(), argumentTypes.end(), arguments);
+    SignatureType* signature = callee->callSignatures().resolve(argumentTypes);
+    _entries[slot] = { callee, arguments, argumentTypes.size(), signature };
+    _size++;
+    return signature;
+}
+
+void rvm::type::OverloadCache::grow() {
+    vector<Entry> entries(_entries.empty() ? 64 : _entries.size() * 2, Entry { nullptr, nullptr, 0, nullptr });
+    size_t mask = entries.size() - 1;
+    for (auto& entry : _entries) {
+        if (entry.callee == nullptr) continue;
+        size_t slot = hashCall(entry.callee, TypeList(entry.arguments, entry.count)) & mask;
+        while (entries[slot].callee != nullptr) slot = (slot + 1) & mask;
+        entries[slot] = entry;
+    }
+    _entries = move(entries);
+}
+
+void rvm::type::OverloadCache::clear() {
+    _entries.clear();
+    _arena = Arena();
+    _size = 0;
+}
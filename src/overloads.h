@@ -0,0 +1,70 @@
+#ifndef RVM_OVERLOADS_H
+#define RVM_OVERLOADS_H
+
+#include <vector>
+#include <unordered_map>
+#include "arena.h"
+#include "types.h"
+
+namespace rvm {
+    namespace type {
+        /// The call signatures of a callee, indexed by arity and the first argument type.
+        /// Types are unique, so a call resolves by looking up the bucket of its arity and first argument type
+        /// and comparing the other argument types by pointer, whatever the number of overloads of the name.
+        class OverloadSet {
+            std::vector<SignatureType*> _signatures;
+            // The signatures in declaration order by the key of their arity and first argument type.
+            std::unordered_map<unsigned long long, std::vector<SignatureType*> > _index;
+
+        public:
+            /// Adds signature, a signature already in the set is not added again.
+            void add(SignatureType* signature);
+
+            /// The signature for values of argumentTypes, the first declared if several match, or nullptr.
+            SignatureType* resolve(TypeList argumentTypes) const;
+
+            /// Removes all signatures.
+            void clear() { _signatures.clear(); _index.clear(); }
+
+            /// The signatures in declaration order.
+            const std::vector<SignatureType*>& signatures() const { return _signatures; }
+            size_t size() const { return _signatures.size(); }
+            bool empty() const { return _signatures.empty(); }
+        };
+
+        /// Memoizes overload resolution by callee and argument types, shared by the calls of a module.
+        /// Repeated calls with the same types are one hash lookup, failed resolutions are kept too.
+        /// The overload sets must not change while the cache is used, clear it after adding signatures.
+        class OverloadCache {
+            struct Entry {
+                // nullptr for empty slots.
+                const Type* callee;
+                Type* const* arguments;
+                size_t count;
+                SignatureType* signature;
+            };
+
+            Arena _arena;
+            std::vector<Entry> _entries;
+            size_t _size;
+
+            void grow();
+
+        public:
+            OverloadCache() : _size(0) {}
+            OverloadCache(const OverloadCache&) = delete;
+            OverloadCache& operator=(const OverloadCache&) = delete;
+
+            /// The signature of callee's call signatures for values of argumentTypes, or nullptr.
+            SignatureType* resolve(const Type* callee, TypeList argumentTypes);
+
+            /// Forgets all resolutions.
+            void clear();
+
+            /// The number of memoized resolutions.
+            size_t size() const { return _size; }
+        };
+    };
+};
+
+#endif
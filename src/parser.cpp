@@ -1,397 +1,354 @@
+#include <array>
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
 #include "parser.h"
+#include "threadpool.h"
 
 using namespace std;
 using namespace rvm;
 using namespace rvm::ast;
 
-typedef std::unique_ptr<rvm::ast::Statement> ptr_statement;
-typedef std::unique_ptr<rvm::ast::TypeExpression> ptr_type;
-typedef std::unique_ptr<rvm::ast::ValueExpression> ptr_value;
-
-inline rvm::Lexer::Token rvm::Parser::consumeToken() {
-    Token token = _lookaheadToken;
+inline unsigned int rvm::Parser::consumeToken() {
+    unsigned int token = (unsigned int)_index;
     if (!is<TokenType::EoF>()) {
-        _lookaheadToken = *++_current;
-        // Ignore whitespace.
+        // Whitespace is dropped by the TokenBuffer.
         // TODO: Capture last comment before members for docs.
-        while(is<TokenType::Whitespace>()) _lookaheadToken = *++_current;
+        ++_index;
+        // Lexer errors surface when the parser reaches them, as if lexing on demand.
+        if (is<TokenType::EoF>()) _tokens.throwIfFailed();
     }
 
     return token;
 }
 
-ptr_value rvm::Parser::parseValueExpression() {
-    // ! Expressions
-    // <Expression> ::= <Prec0Exp> | <Prec1Exp>
-
-    // ! Assignment Operators
-    // <Prec0Exp> ::= <Assign>
-    //             | <AddAssign>
-    //             | <SubtractAssign>
-    //             | <MultiplyAssign>
-    //             | <DivideAssign>
-    //             | <BitAndAssign>
-    //             | <BitXorAssign>
-    //             | <BitOrAssign>
-    //             | <ReminderAssign>
-    //             | <ShiftLeftAssign>
-    //             | <ShiftRightAssign>
-
-    ptr_value lhs = parsePrec1ValueExpression();
-    if (lhs->precedence() >= 12) {
-        if (is<TokenType::Assignment>()) {
-            // <Assign> ::= <Prec12Exp> assign <Expression>
-            auto token = consume<TokenType::Assignment>();
-            auto rhs = parseValueExpression();
-            lhs = std::make_unique<AssignmentExpression>(move(lhs), token, move(rhs));
-        } else if (is<TokenType::AdditionAssignment>()) {
-            // <AddAssign> ::= <Prec12Exp> add-assign <Expression>
-            auto token = consume<TokenType::AdditionAssignment>();
-            auto rhs = parseValueExpression();
-            lhs = std::make_unique<AdditionAssignmentExpression>(move(lhs), token, move(rhs));
-        } else if (is<TokenType::SubtractionAssignment>()) {
-            // <SubtractAssign> ::= <Prec12Exp> subtract-assign <Expression>
-            auto token = consume<TokenType::SubtractionAssignment>();
-            auto rhs = parseValueExpression();
-            lhs = std::make_unique<SubtractionAssignmentExpression>(move(lhs), token, move(rhs));
-        } else if (is<TokenType::MultiplicationAssignment>()) {
-            // <MultiplyAssign> ::= <Prec12Exp> multiply-assign <Expression>
-            auto token = consume<TokenType::MultiplicationAssignment>();
-            auto rhs = parseValueExpression();
-            lhs = std::make_unique<MultiplicationAssignmentExpression>(move(lhs), token, move(rhs));
-        } else if (is<TokenType::DivisionAssignment>()) {
-            // <DivideAssign> ::= <Prec12Exp> divide-assign <Expression>
-            auto token = consume<TokenType::DivisionAssignment>();
-            auto rhs = parseValueExpression();
-            lhs = std::make_unique<DivisionAssignmentExpression>(move(lhs), token, move(rhs));
-        } else if (is<TokenType::BitAndAssignment>()) {
-            // <BitAndAssign> ::= <Prec12Exp> bit-and-assign <Expression>
-            auto token = consume<TokenType::BitAndAssignment>();
-            auto rhs = parseValueExpression();
-            lhs = std::make_unique<BitAndAssignmentExpression>(move(lhs), token, move(rhs));
-        } else if (is<TokenType::BitXOrAssignment>()) {
-            // <BitXorAssign> ::= <Prec12Exp> bit-xor-assign <Expression>
-            auto token = consume<TokenType::BitXOrAssignment>();
-            auto rhs = parseValueExpression();
-            lhs = std::make_unique<BitXOrAssignmentExpression>(move(lhs), token, move(rhs));
-        } else if (is<TokenType::BitOrAssignment>()) {
-            // <BitOrAssign> ::= <Prec12Exp> bit-or-assign <Expression>
-            auto token = consume<TokenType::BitOrAssignment>();
-            auto rhs = parseValueExpression();
-            lhs = std::make_unique<BitOrAssignmentExpression>(move(lhs), token, move(rhs));
-        } else if (is<TokenType::ReminderAssignment>()) {
-            // <ReminderAssign> ::= <Prec12Exp> reminder-assign <Expression>
-            auto token = consume<TokenType::ReminderAssignment>();
-            auto rhs = parseValueExpression();
-            lhs = std::make_unique<ReminderAssignmentExpression>(move(lhs), token, move(rhs));
-        } else if (is<TokenType::LeftShiftAssignment>()) {
-            // <ShiftLeftAssign> ::= <Prec12Exp> shift-left-assign <Expression>
-            auto token = consume<TokenType::LeftShiftAssignment>();
-            auto rhs = parseValueExpression();
-            lhs = std::make_unique<LeftShiftAssignmentExpression>(move(lhs), token, move(rhs));
-        } else if (is<TokenType::RightShiftAssignment>()) {
-            // <ShiftRightAssign> ::= <Prec12Exp> shift-right-assign <Expression>
-            auto token = consume<TokenType::RightShiftAssignment>();
-            auto rhs = parseValueExpression();
-            lhs = std::make_unique<RightShiftAssignmentExpression>(move(lhs), token, move(rhs));
-        }
-    }
-    return lhs;
-}
-
-ptr_value rvm::Parser::parsePrec1ValueExpression() {
-    // ! Conditional If Operators
-    // <Prec1Exp> ::= <ConditionalIf> | <Prec2Exp>
-    // <ConditionalIf> ::= <Prec2Exp> question <Expression> colon <Expression>
-    ptr_value conditionExpression = parsePrec2ValueExpression();
-    if (!is<TokenType::Question>()) return conditionExpression;
-
-    consume<TokenType::Question>();
-    ptr_value thenExpression = parseValueExpression();
-    consume<TokenType::Colon>();
-    ptr_value elseExpression = parseValueExpression();
-    return std::make_unique<ConditionalIfExpression>(move(conditionExpression), move(thenExpression), move(elseExpression));
+void rvm::Parser::error(ErrorCode code, SourceSpan span) {
+    _failed = true;
+    if (_diagnostics == nullptr) throw CompilerError(code, span);
+    // Error tokens were reported by the lexer, and one error per statement is enough.
+    if (!_recovering && !is<TokenType::Error>()) _diagnostics->report(code, span);
+    _recovering = true;
 }
 
-ptr_value rvm::Parser::parsePrec2ValueExpression() {
-    // ! Conditional Operators
-    // <Prec2Exp> ::= <Prec3Exp> | <ConditionalOr>
-    // <ConditionalOr> ::= <Prec2Exp> conditional-or <Prec3Exp>       
-    ptr_value lhs = parsePrec3ValueExpression();
-    while(is<TokenType::ConditionalOr>()) {
-        auto token = consume<TokenType::ConditionalOr>();
-        auto rhs = parsePrec3ValueExpression();
-        lhs = std::make_unique<ConditionalOrExpression>(move(lhs), token, move(rhs));
-    }
-    return lhs;
-}
-
-ptr_value rvm::Parser::parsePrec3ValueExpression() {
-    // ! Conditional Operators
-    // <Prec3Exp> ::= <Prec4Exp> | <ConditionalAnd>
-    // <ConditionalAnd> ::=  <Prec3Exp> conditional-and <Prec4Exp>
-    ptr_value lhs = parsePrec4ValueExpression();
-    while(is<TokenType::ConditionalAnd>()) {
-        auto token = consume<TokenType::ConditionalAnd>();
-        auto rhs = parsePrec4ValueExpression();
-        lhs = std::make_unique<ConditionalAndExpression>(move(lhs), token, move(rhs));
-    }
-    return lhs;
-}
-
-ptr_value rvm::Parser::parsePrec4ValueExpression() {
-    // ! Bitwise Operators
-    // <Prec4Exp> ::= <Prec5Exp> | <BitwiseOr>
-    // <BitwiseOr> ::= <Prec4Exp> bitwise-or <Prec5Exp>
-    ptr_value lhs = parsePrec5ValueExpression();
-    while(is<TokenType::BitwiseOr>()) {
-        auto token = consume<TokenType::BitwiseOr>();
-        auto rhs = parsePrec5ValueExpression();
-        lhs = std::make_unique<BitwiseOrExpression>(move(lhs), token, move(rhs));
-    }
-    return lhs;
-}
-
-ptr_value rvm::Parser::parsePrec5ValueExpression() {
-    // <Prec5Exp> ::= <Prec6Exp> | <BitwiseXOr>
-    // <BitwiseXOr> ::= <Prec5Exp> bitwise-xor <Prec6Exp>
-    ptr_value lhs = parsePrec6ValueExpression();
-    while(is<TokenType::BitwiseXOr>()) {
-        auto token = consume<TokenType::BitwiseXOr>();
-        auto rhs = parsePrec6ValueExpression();
-        lhs = std::make_unique<BitwiseXOrExpression>(move(lhs), token, move(rhs));
-    }
-    return lhs;
-}
-
-ptr_value rvm::Parser::parsePrec6ValueExpression() {
-    // <Prec6Exp> ::= <Prec7Exp> | <BitwiseAnd>
-    // <BitwiseAnd> ::= <Prec6Exp> bitwise-and <Prec7Exp>
-    ptr_value lhs = parsePrec7ValueExpression();
-    while(is<TokenType::BitwiseAnd>()) {
-        auto token = consume<TokenType::BitwiseAnd>();
-        auto rhs = parsePrec7ValueExpression();
-        lhs = std::make_unique<BitwiseAndExpression>(move(lhs), token, move(rhs));
+// Skips the rest of a statement that failed from start, up to and including its semicolon,
+// or to a closing brace, a statement keyword or a member keyword.
+// Recovery goes on at a member keyword, the code block was not closed.
+void rvm::Parser::synchronizeStatement(size_t start) {
+    bool ended = _index > start && _tokens.kind(_index - 1) == TokenType::Semicolon;
+    if (!ended) {
+        while(!is<TokenType::Semicolon>() && !is<TokenType::RightBrace>() && !is<TokenType::EoF>()
+            && !is<TokenType::ConstKeyword>() && !is<TokenType::ReturnKeyword>()
+            && !is<TokenType::FunctionKeyword>() && !is<TokenType::DeclareKeyword>()) {
+            consumeToken();
+        }
+        if (is<TokenType::Semicolon>()) consumeToken();
     }
-    return lhs;
-}
-
-ptr_value rvm::Parser::parsePrec7ValueExpression() {
-    // ! Equality Operators
-    // <Prec7Exp> ::= <Prec8Exp> | <Equal> | <NotEqual>
-    ptr_value lhs = parsePrec8ValueExpression();
-    do {
-        if (is<TokenType::Equal>()) {
-            // <Equal> ::= <Prec7Exp> equal <Prec8Exp>
-            auto token = consume<TokenType::Equal>();
-            auto rhs = parsePrec8ValueExpression();
-            lhs = std::make_unique<EqualExpression>(move(lhs), token, move(rhs));
-        } else if (is<TokenType::NotEqual>()) {
-            // <NotEqual> ::= <Prec7Exp> not-equal <Prec8Exp>
-            auto token = consume<TokenType::NotEqual>();
-            auto rhs = parsePrec8ValueExpression();
-            lhs = std::make_unique<NotEqualExpression>(move(lhs), token, move(rhs));
-        } else break;
-    } while(true);
-    return lhs;
+    _recovering = is<TokenType::FunctionKeyword>() || is<TokenType::DeclareKeyword>();
 }
 
-ptr_value rvm::Parser::parsePrec8ValueExpression() {
-    // ! Comparison Operators
-    // <Prec8Exp> ::= <Prec9Exp> | <LessThan> | <GreaterThan> | <LessOrEqual> | <GreaterOrEqual>
-    ptr_value lhs = parsePrec9ValueExpression();
-    do {
-        if (is<TokenType::Less>()) {
-            // <LessThan> ::= <Prec8Exp> less-than <Prec9Exp>
-            auto token = consume<TokenType::Less>();
-            auto rhs = parsePrec9ValueExpression();
-            lhs = std::make_unique<LessThanExpression>(move(lhs), token, move(rhs));
-        } else if (is<TokenType::Greater>()) {
-            // <GreaterThan> ::= <Prec8Exp> greater-than <Prec9Exp>
-            auto token = consume<TokenType::Greater>();
-            auto rhs = parsePrec9ValueExpression();
-            lhs = std::make_unique<GreaterThanExpression>(move(lhs), token, move(rhs));
-        } else if (is<TokenType::LessOrEqual>()) {
-            // <LessOrEqual> ::= <Prec8Exp> less-or-equal <Prec9Exp>
-            auto token = consume<TokenType::LessOrEqual>();
-            auto rhs = parsePrec9ValueExpression();
-            lhs = std::make_unique<LessOrEqualExpression>(move(lhs), token, move(rhs));
-        } else if (is<TokenType::GreaterOrEqual>()) {
-            // <GreaterOrEqual> ::= <Prec8Exp> greater-or-equal <Prec9Exp>
-            auto token = consume<TokenType::GreaterOrEqual>();
-            auto rhs = parsePrec9ValueExpression();
-            lhs = std::make_unique<GreaterOrEqualExpression>(move(lhs), token, move(rhs));
-        } else break;
-    } while(true);
-    return lhs;
+// Skips to the next member keyword.
+void rvm::Parser::synchronizeMember() {
+    while(!is<TokenType::FunctionKeyword>() && !is<TokenType::DeclareKeyword>() && !is<TokenType::EoF>()) consumeToken();
+    _recovering = false;
 }
 
-ptr_value rvm::Parser::parsePrec9ValueExpression() {
-    // ! Shift Operators
-    // <Prec9Exp> ::= <Prec10Exp> | <LeftShift> | <RightShift>
-    ptr_value lhs = parsePrec10ValueExpression();
-
-    do {
-        if (is<TokenType::LeftShift>()) {
-            // <LeftShift> ::= <Prec9Exp> shift-left <Prec10Exp>
-            auto token = consume<TokenType::LeftShift>();
-            auto rhs = parsePrec10ValueExpression();
-            lhs = std::make_unique<LeftShiftExpression>(move(lhs), token, move(rhs));
-        } else if (is<TokenType::RightShift>()) {
-            // <RightShift> ::= <Prec9Exp> shift-right <Prec10Exp>
-            auto token = consume<TokenType::RightShift>();
-            auto rhs = parsePrec10ValueExpression(); 
-            lhs = std::make_unique<RightShiftExpression>(move(lhs), token, move(rhs));
-        } else break;
-    } while(true);
-    return lhs;
+namespace {
+    enum class Infix : unsigned char {
+        None,
+        // Left associative, the right operand is parsed at the next precedence.
+        Binary,
+        // Right associative and only after unary and primary expressions.
+        Assignment,
+        // <ConditionalIf> ::= <Prec2Exp> question <Expression> colon <Expression>
+        Conditional,
+    };
+
+    /// How a token parses as an operator, in infix position and in prefix position.
+    struct Operator {
+        Infix infix;
+        unsigned char precedence;
+        BinaryOperator binary;
+        bool isPrefix;
+        UnaryOperator prefix;
+    };
+
+    // The precedences match Tree::precedence, see ast.cpp.
+    // A new operator is one entry here and its operator enum in ast.h.
+    constexpr std::array<Operator, 256> operators = []() constexpr {
+        std::array<Operator, 256> table {};
+        auto binary = [&table](TokenType type, Infix infix, unsigned char precedence, BinaryOperator op) constexpr {
+            table[size_t(type)].infix = infix;
+            table[size_t(type)].precedence = precedence;
+            table[size_t(type)].binary = op;
+        };
+        auto prefix = [&table](TokenType type, UnaryOperator op) constexpr {
+            table[size_t(type)].isPrefix = true;
+            table[size_t(type)].prefix = op;
+        };
+
+        // Precedence 0
+        binary(TokenType::Assignment, Infix::Assignment, 0, AssignmentOperator);
+        binary(TokenType::AdditionAssignment, Infix::Assignment, 0, AdditionAssignmentOperator);
+        binary(TokenType::SubtractionAssignment, Infix::Assignment, 0, SubtractionAssignmentOperator);
+        binary(TokenType::MultiplicationAssignment, Infix::Assignment, 0, MultiplicationAssignmentOperator);
+        binary(TokenType::DivisionAssignment, Infix::Assignment, 0, DivisionAssignmentOperator);
+        binary(TokenType::BitAndAssignment, Infix::Assignment, 0, BitAndAssignmentOperator);
+        binary(TokenType::BitXOrAssignment, Infix::Assignment, 0, BitXOrAssignmentOperator);
+        binary(TokenType::BitOrAssignment, Infix::Assignment, 0, BitOrAssignmentOperator);
+        binary(TokenType::ReminderAssignment, Infix::Assignment, 0, ReminderAssignmentOperator);
+        binary(TokenType::LeftShiftAssignment, Infix::Assignment, 0, LeftShiftAssignmentOperator);
+        binary(TokenType::RightShiftAssignment, Infix::Assignment, 0, RightShiftAssignmentOperator);
+
+        // Precedence 1
+        table[size_t(TokenType::Question)].infix = Infix::Conditional;
+        table[size_t(TokenType::Question)].precedence = 1;
+
+        // Precedence 2 to 11
+        binary(TokenType::ConditionalOr, Infix::Binary, 2, ConditionalOrOperator);
+        binary(TokenType::ConditionalAnd, Infix::Binary, 3, ConditionalAndOperator);
+        binary(TokenType::BitwiseOr, Infix::Binary, 4, BitwiseOrOperator);
+        binary(TokenType::BitwiseXOr, Infix::Binary, 5, BitwiseXOrOperator);
+        binary(TokenType::BitwiseAnd, Infix::Binary, 6, BitwiseAndOperator);
+        binary(TokenType::Equal, Infix::Binary, 7, EqualOperator);
+        binary(TokenType::NotEqual, Infix::Binary, 7, NotEqualOperator);
+        binary(TokenType::Less, Infix::Binary, 8, LessThanOperator);
+        binary(TokenType::Greater, Infix::Binary, 8, GreaterThanOperator);
+        binary(TokenType::LessOrEqual, Infix::Binary, 8, LessOrEqualOperator);
+        binary(TokenType::GreaterOrEqual, Infix::Binary, 8, GreaterOrEqualOperator);
+        binary(TokenType::LeftShift, Infix::Binary, 9, LeftShiftOperator);
+        binary(TokenType::RightShift, Infix::Binary, 9, RightShiftOperator);
+        binary(TokenType::Plus, Infix::Binary, 10, AddOperator);
+        binary(TokenType::Minus, Infix::Binary, 10, SubtractOperator);
+        binary(TokenType::Multiply, Infix::Binary, 11, MultiplyOperator);
+        binary(TokenType::Divide, Infix::Binary, 11, DivideOperator);
+        binary(TokenType::Reminder, Infix::Binary, 11, ReminderOperator);
+
+        // Precedence 12
+        prefix(TokenType::ConditionalNot, ConditionalNotOperator);
+        prefix(TokenType::Plus, UnaryPlusOperator);
+        prefix(TokenType::Minus, UnaryMinusOperator);
+        prefix(TokenType::Increment, PreIncrementOperator);
+        prefix(TokenType::Decrement, PreDecrementOperator);
+        prefix(TokenType::BitComplement, BitComplementOperator);
+        return table;
+    }();
 }
 
-ptr_value rvm::Parser::parsePrec10ValueExpression() {
-    // Precedence 10 operators: Cumulative Operators
-    // <Prec10Exp> ::= <Prec11Exp> | <Add> | <Subtract>
-
-    // <Prec11Exp>
-    ptr_value prec10Exp = parsePrec11ValueExpression();
-    do {
-        if (is<TokenType::Plus>()) {
-            // <Add> ::= <Prec10Exp> plus <Prec11Exp>
-            auto token = consume<TokenType::Plus>();
-            auto rhs = parsePrec11ValueExpression();
-            prec10Exp = std::make_unique<AddExpression>(move(prec10Exp), token, move(rhs));
-        } else if (is<TokenType::Minus>()) {
-            // <Subtract> ::= <Prec10Exp> minus <Prec11Exp>
-            auto token = consume<TokenType::Minus>();
-            auto rhs = parsePrec11ValueExpression();
-            prec10Exp = std::make_unique<SubtractExpression>(move(prec10Exp), token, move(rhs));
-        } else break;
-    } while(true);
-    return prec10Exp;
+NodeId rvm::Parser::parseValueExpression() {
+    // ! Expressions
+    // <Expression> ::= <Prec0Exp> | <Prec1Exp>
+    return parseOperatorExpression(0);
 }
 
-ptr_value rvm::Parser::parsePrec11ValueExpression() {
-    // Precedence 11 operators: Multiplicative Operators
-    // <Prec11Exp> ::= <Prec12Exp> | <Multiply> | <Divide> | <Reminder>
-
-    // <Prec12Exp>
-    ptr_value prec11Exp = parsePrec12ValueExpression();
+// Precedence climbing over the operators table: operators of at least precedence extend the
+// expression, the right operand of a binary operator takes only operators that bind tighter.
+//
+// Nested expressions push a frame on _expressions instead of recursing, each frame is an operator
+// expression waiting for an operand or the expression in parentheses or arguments it is in.
+// Each operator expression and prefix operator nests one level, past _maxNesting the operand is an error.
+NodeId rvm::Parser::parseOperatorExpression(unsigned int precedence) {
+    typedef ExpressionFrame::State State;
+    enum class Step {
+        // Parse an operand: prefix operators, then a primary expression.
+        Operand,
+        // Parse the postfix operators of the primary expression in value.
+        Postfix,
+        // value is a complete <Prec12Exp>, apply the prefix operators waiting for it.
+        Prefix,
+        // Extend the lhs of the operator expression on top with infix operators.
+        Infix,
+        // The operator expression on top was popped and its value is complete.
+        Complete,
+    };
+
+    _expressions.clear();
+    unsigned int nesting = 0;
+    NodeId value = noNode;
+    Step step = Step::Complete;
+
+    auto startOperatorExpression = [&](unsigned int precedence) {
+        if (nesting >= _maxNesting) {
+            error(ExpressionTooDeep, span());
+            value = noNode;
+            return Step::Complete;
+        }
+        nesting++;
+        _expressions.push_back({ State::Infix, 0, noToken, precedence, noNode, noNode, 0 });
+        return Step::Operand;
+    };
+    auto completeOperatorExpression = [&](NodeId result) {
+        _expressions.pop_back();
+        nesting--;
+        value = result;
+        return Step::Complete;
+    };
+
+    step = startOperatorExpression(precedence);
     do {
-        if (is<TokenType::Multiply>()) {
-            // <Multiply> ::= <Prec11Exp> multiply <Prec12Exp>
-            auto token = consume<TokenType::Multiply>();
-            auto rhs = parsePrec12ValueExpression();
-            prec11Exp = std::make_unique<MultiplyExpression>(move(prec11Exp), token, move(rhs));
-        } else if (is<TokenType::Divide>()) {
-            // <Divide> ::= <Prec11Exp> divide <Prec12Exp>
-            auto token = consume<TokenType::Divide>();
-            auto rhs = parsePrec12ValueExpression();
-            prec11Exp = std::make_unique<DivideExpression>(move(prec11Exp), token, move(rhs));
-        } else if (is<TokenType::Reminder>()) {
-            // <Reminder> ::= <Prec11Exp> reminder <Prec12Exp>
-            auto token = consume<TokenType::Reminder>();
-            auto rhs = parsePrec12ValueExpression();
-            prec11Exp = std::make_unique<ReminderExpression>(move(prec11Exp), token, move(rhs));
-        } else break;
-    } while(true);
-    return prec11Exp;
-}
-
-ptr_value rvm::Parser::parsePrec12ValueExpression() {
-    // Precedence 12 operators: Unary Pre-Operators
-    // <Prec12Exp> ::= 
-    //             | <Not>
-    //             | <Plus>
-    //             | <Minus>
-    //             | <PreIncrement>
-    //             | <PreDecrement>
-    //             | <BitComplement>
-    //             | <Prec13Exp>
-
-    if (is<TokenType::ConditionalNot>()) {
-        auto token = consume<TokenType::ConditionalNot>();
-        auto expression = parsePrec12ValueExpression();
-        return std::make_unique<ConditionalNotExpression>(token, move(expression));
-    } else if (is<TokenType::Plus>()) {
-        auto token = consume<TokenType::Plus>();
-        auto expression = parsePrec12ValueExpression();
-        return std::make_unique<UnaryPlusExpression>(token, move(expression));
-    } else if (is<TokenType::Minus>()) {
-        auto token = consume<TokenType::Minus>();
-        auto expression = parsePrec12ValueExpression();
-        return std::make_unique<UnaryMinusExpression>(token, move(expression));
-    } else if (is<TokenType::Increment>()) {
-        auto token = consume<TokenType::Increment>();
-        auto expression = parsePrec12ValueExpression();
-        return std::make_unique<PreIncrementExpression>(token, move(expression));
-    } else if (is<TokenType::Decrement>()) {
-        auto token = consume<TokenType::Decrement>();
-        auto expression = parsePrec12ValueExpression();
-        return std::make_unique<PreDecrementExpression>(token, move(expression));
-    } else if (is<TokenType::BitComplement>()) {
-        auto token = consume<TokenType::BitComplement>();
-        auto expression = parsePrec12ValueExpression();
-        return std::make_unique<BitComplementExpression>(token, move(expression));
-    } else return parsePrec13ValueExpression();
-}
+        switch (step) {
+            case Step::Operand: {
+                // Precedence 12 operators: Unary Pre-Operators
+                // <Prec12Exp> ::= <Not> | <Plus> | <Minus> | <PreIncrement> | <PreDecrement> | <BitComplement> | <Prec13Exp>
+                const Operator* op = &operators[size_t(_tokens.kind(_index))];
+                for (; op->isPrefix; op = &operators[size_t(_tokens.kind(_index))]) {
+                    if (nesting >= _maxNesting) {
+                        error(ExpressionTooDeep, span());
+                        break;
+                    }
+                    nesting++;
+                    _expressions.push_back({ State::Prefix, op->prefix, consumeToken(), 0, noNode, noNode, 0 });
+                }
+                if (op->isPrefix) {
+                    value = noNode;
+                    step = Step::Prefix;
+                    break;
+                }
+
+                // Precedence 13 operators: Unary Post-Operators and Base Expressions
+                // <Prec13Exp> ::=
+                // <Identifier>
+                step = Step::Postfix;
+                if (is<TokenType::Identifier>()) value = _tree.add(Kind::Identifier, 0, consume<TokenType::Identifier>(), {});
+                // <ConstantValue>
+                else if (is<TokenType::Float>()) value = _tree.add(Kind::ConstantValue, 0, consume<TokenType::Float>(), {});
+                else if (is<TokenType::Integer>()) value = _tree.add(Kind::ConstantValue, 0, consume<TokenType::Integer>(), {});
+                else if (is<TokenType::SingleQuotesString>()) value = _tree.add(Kind::ConstantValue, 0, consume<TokenType::SingleQuotesString>(), {});
+                else if (is<TokenType::DoubleQuotesString>()) value = _tree.add(Kind::ConstantValue, 0, consume<TokenType::DoubleQuotesString>(), {});
+                // <ParenExpression>
+                else if (is<TokenType::OpenParenthesis>()) {
+                    consume<TokenType::OpenParenthesis>();
+                    _expressions.push_back({ State::Parenthesis, 0, noToken, 0, noNode, noNode, 0 });
+                    step = startOperatorExpression(0);
+                }
+                else {
+                    error(UnexpectedParserEoF, span());
+                    value = noNode;
+                    step = Step::Prefix;
+                }
+                break;
+            }
 
-ptr_value rvm::Parser::parsePrec13ValueExpression() {
-    ptr_value prec13Exp = nullptr;
-    // Precedence 13 operators: Unary Post-Operators and Base Expressions
-    // <Prec13Exp> ::=
-    // <Identifier>
-    if (is<TokenType::Identifier>()) prec13Exp = std::make_unique<IdentifierExpression>(consume<TokenType::Identifier>());
-    // <ConstantValue>
-    else if (is<TokenType::Float>()) prec13Exp = std::make_unique<ConstantValueExpression>(consume<TokenType::Float>());
-    else if (is<TokenType::Integer>()) prec13Exp = std::make_unique<ConstantValueExpression>(consume<TokenType::Integer>());
-    else if (is<TokenType::SingleQuotesString>()) prec13Exp = std::make_unique<ConstantValueExpression>(consume<TokenType::SingleQuotesString>());
-    else if (is<TokenType::DoubleQuotesString>()) prec13Exp = std::make_unique<ConstantValueExpression>(consume<TokenType::DoubleQuotesString>());
-    // <ParenExpression>
-    else if (is<TokenType::OpenParenthesis>()) {
-        consume<TokenType::OpenParenthesis>();
-        prec13Exp = parseValueExpression();
-        consume<TokenType::CloseParenthesis>();
-    }
-    else throw CompilerError(UnexpectedParserEoF, span());
+            case Step::Postfix:
+                // <MemberAccess> ::= <Prec13Exp> dot <Member>
+                if (is<TokenType::Dot>()) {
+                    consume<TokenType::Dot>();
+                    // <Member> ::= Identifier
+                    auto name = consume<TokenType::Identifier>();
+                    value = _tree.add(Kind::MemberAccess, 0, name, { value });
+                } else if (is<TokenType::OpenParenthesis>()) {
+                    // <Invocation> ::= <Prec13Exp> l-paren <Values> r-paren
+                    auto parenthesis = consume<TokenType::OpenParenthesis>();
+                    // <Values> ::= <Expression> comma <Values> | <Expression> | <>
+                    size_t start = _listItems.size();
+                    if (!is<TokenType::CloseParenthesis>()) {
+                        _expressions.push_back({ State::Argument, 0, parenthesis, 0, value, noNode, start });
+                        step = startOperatorExpression(0);
+                        break;
+                    }
+                    consume<TokenType::CloseParenthesis>();
+                    value = makeList(Kind::Invocation, parenthesis, { value }, start);
+                } else if (is<TokenType::Increment>()) {
+                    // <PostIncrement> ::= <Prec13Exp> increment
+                    auto token = consume<TokenType::Increment>();
+                    value = _tree.add(Kind::Unary, PostIncrementOperator, token, { value });
+                } else if (is<TokenType::Decrement>()) {
+                    // <PostDecrement> ::= <Prec13Exp> decrement
+                    auto token = consume<TokenType::Decrement>();
+                    value = _tree.add(Kind::Unary, PostDecrementOperator, token, { value });
+                } else step = Step::Prefix;
+                break;
+
+            case Step::Prefix:
+                for (; _expressions.back().state == State::Prefix; _expressions.pop_back(), nesting--) {
+                    const ExpressionFrame& frame = _expressions.back();
+                    value = _tree.add(Kind::Unary, frame.op, frame.token, { value });
+                }
+                _expressions.back().lhs = value;
+                step = Step::Infix;
+                break;
+
+            case Step::Infix: {
+                ExpressionFrame& frame = _expressions.back();
+                const Operator& op = operators[size_t(_tokens.kind(_index))];
+                if (op.infix == Infix::None || op.precedence < frame.precedence) {
+                    step = completeOperatorExpression(frame.lhs);
+                } else if (op.infix == Infix::Assignment) {
+                    // <Assign> ::= <Prec12Exp> assign <Expression>
+                    if (frame.lhs == noNode || _tree.precedence(frame.lhs) < 12) {
+                        step = completeOperatorExpression(frame.lhs);
+                        break;
+                    }
+                    frame.state = State::Assignment;
+                    frame.op = op.binary;
+                    frame.token = consumeToken();
+                    step = startOperatorExpression(0);
+                } else if (op.infix == Infix::Conditional) {
+                    // <ConditionalIf> ::= <Prec2Exp> question <Expression> colon <Expression>
+                    frame.state = State::Then;
+                    frame.token = consume<TokenType::Question>();
+                    step = startOperatorExpression(0);
+                } else {
+                    frame.state = State::Operand;
+                    frame.op = op.binary;
+                    frame.token = consumeToken();
+                    step = startOperatorExpression(op.precedence + 1);
+                }
+                break;
+            }
 
-    do {
-        // <MemberAccess> ::= <Prec13Exp> dot <Member>
-        if (is<TokenType::Dot>()) {
-            consume<TokenType::Dot>();
-            // <Member> ::= Identifier
-            auto name = consume<TokenType::Identifier>();
-            prec13Exp = std::make_unique<MemberAccessExpression>(move(prec13Exp), name);
-        } else if (is<TokenType::OpenParenthesis>()) {
-            // <Invocation> ::= <Prec13Exp> l-paren <Values> r-paren
-            consume<TokenType::OpenParenthesis>();
-            // <Values> ::= <Expression> comma <Values> | <Expression> | <>
-            vector<ptr_value> values;
-            if (!is<TokenType::CloseParenthesis>()) {
-                do {
-                    values.push_back(parseValueExpression());
-                    if (is<TokenType::Comma>()) consume<TokenType::Comma>();
-                    else break;
-                } while(true);
+            case Step::Complete: {
+                if (_expressions.empty()) return value;
+                ExpressionFrame& frame = _expressions.back();
+                switch (frame.state) {
+                    case State::Operand:
+                        frame.lhs = _tree.add(Kind::Binary, frame.op, frame.token, { frame.lhs, value });
+                        frame.state = State::Infix;
+                        step = Step::Infix;
+                        break;
+                    case State::Assignment:
+                        step = completeOperatorExpression(_tree.add(Kind::Binary, frame.op, frame.token, { frame.lhs, value }));
+                        break;
+                    case State::Then:
+                        frame.then = value;
+                        consume<TokenType::Colon>();
+                        frame.state = State::Else;
+                        step = startOperatorExpression(0);
+                        break;
+                    case State::Else:
+                        step = completeOperatorExpression(_tree.add(Kind::ConditionalIf, 0, frame.token, { frame.lhs, frame.then, value }));
+                        break;
+                    case State::Parenthesis:
+                        consume<TokenType::CloseParenthesis>();
+                        _expressions.pop_back();
+                        step = Step::Postfix;
+                        break;
+                    case State::Argument:
+                        _listItems.push_back(value);
+                        if (is<TokenType::Comma>()) {
+                            consume<TokenType::Comma>();
+                            step = startOperatorExpression(0);
+                            break;
+                        }
+                        consume<TokenType::CloseParenthesis>();
+                        value = makeList(Kind::Invocation, frame.token, { frame.lhs }, frame.start);
+                        _expressions.pop_back();
+                        step = Step::Postfix;
+                        break;
+                    default:
+                        break;
+                }
+                break;
             }
-            consume<TokenType::CloseParenthesis>();
-            prec13Exp = std::make_unique<InvocationExpression>(move(prec13Exp), move(values));
-        } else if (is<TokenType::Increment>()) {
-            // <PostIncrement> ::= <Prec13Exp> increment
-            auto token = consume<TokenType::Increment>();
-            prec13Exp = std::make_unique<PostIncrementExpression>(move(prec13Exp), token);
-        } else if (is<TokenType::Decrement>()) {
-            // <PostDecrement> ::= <Prec13Exp> decrement
-            auto token = consume<TokenType::Decrement>();
-            prec13Exp = std::make_unique<PostDecrementExpression>(move(prec13Exp), token);
-        } else break;
+        }
     } while(true);
-    return prec13Exp;
 }
 
-unique_ptr<ConstStatement> rvm::Parser::parseConstStatement() {
+NodeId rvm::Parser::parseConstStatement() {
     consume<TokenType::ConstKeyword>();
     auto name = consume<TokenType::Identifier>();
 
-    ptr_type type = nullptr;
+    NodeId type = noNode;
     if (is<TokenType::Colon>()) {
         consume<TokenType::Colon>();
         type = parseTypeExpression();
@@ -400,118 +357,376 @@ unique_ptr<ConstStatement> rvm::Parser::parseConstStatement() {
     consume<TokenType::Assignment>();
     auto value = parseValueExpression();
     consume<TokenType::Semicolon>();
-    return std::make_unique<ConstStatement>(name, move(type), move(value));
+    return _tree.add(Kind::ConstStatement, 0, name, { type, value });
 }
 
-unique_ptr<ReturnStatement> rvm::Parser::parseReturnStatement() {
-    consume<TokenType::ReturnKeyword>();
-    ptr_value value = nullptr;
+NodeId rvm::Parser::parseReturnStatement() {
+    auto keyword = consume<TokenType::ReturnKeyword>();
+    NodeId value = noNode;
     if (!is<TokenType::Semicolon>()) value = parseValueExpression();
     consume<TokenType::Semicolon>();
-    return std::make_unique<ReturnStatement>(move(value));
+    return _tree.add(Kind::ReturnStatement, 0, keyword, { value });
 }
 
-ptr_statement rvm::Parser::parseStatement() {
+NodeId rvm::Parser::parseStatement() {
     if (is<TokenType::ConstKeyword>()) return parseConstStatement();
     if (is<TokenType::ReturnKeyword>()) return parseReturnStatement();
 
     // TODO: if, do, while, for, throw, catch etc.
 
-    ptr_statement expression = parseValueExpression();
+    NodeId expression = parseValueExpression();
     consume<TokenType::Semicolon>();
     return expression;
 }
 
-unique_ptr<CodeBlock> rvm::Parser::parseCodeBlock() {
-    consume<TokenType::LeftBrace>();
-    vector<ptr_statement> _statements;
+NodeId rvm::Parser::parseCodeBlock() {
+    if (!expect<TokenType::LeftBrace>()) return noNode;
+    auto brace = consumeToken();
+    size_t statements = _listItems.size();
     while(!is<TokenType::RightBrace>()) {
-        if (is<TokenType::EoF>()) throw CompilerError(UnexpectedParserEoF, span());
-        _statements.push_back(parseStatement());
+        if (is<TokenType::EoF>()) {
+            error(UnexpectedParserEoF, span());
+            _listItems.resize(statements);
+            return noNode;
+        }
+        size_t start = _index;
+        NodeId statement = parseStatement();
+        if (_recovering) {
+            synchronizeStatement(start);
+            if (_recovering) {
+                _listItems.resize(statements);
+                return noNode;
+            }
+        } else {
+            _listItems.push_back(statement);
+        }
     }
     consume<TokenType::RightBrace>();
-    return std::make_unique<CodeBlock>(move(_statements));
+    return makeList(Kind::CodeBlock, brace, {}, statements);
 }
 
-ptr_type rvm::Parser::parseTypeExpression() {
+NodeId rvm::Parser::parseTypeExpression() {
     if (is<TokenType::IntKeyword>()) {
-        return std::make_unique<PrimitiveTypeExpression>(consume<TokenType::IntKeyword>(), PrimitiveType::Int);
+        return _tree.add(Kind::PrimitiveType, PrimitiveType::Int, consume<TokenType::IntKeyword>(), {});
     } else if (is<TokenType::FloatKeyword>()) {
-        return std::make_unique<PrimitiveTypeExpression>(consume<TokenType::FloatKeyword>(), PrimitiveType::Float);
+        return _tree.add(Kind::PrimitiveType, PrimitiveType::Float, consume<TokenType::FloatKeyword>(), {});
     } else if (is<TokenType::StringKeyword>()) {
-        return std::make_unique<PrimitiveTypeExpression>(consume<TokenType::StringKeyword>(), PrimitiveType::String);
+        return _tree.add(Kind::PrimitiveType, PrimitiveType::String, consume<TokenType::StringKeyword>(), {});
     } else if (is<TokenType::BoolKeyword>()) {
-        return std::make_unique<PrimitiveTypeExpression>(consume<TokenType::BoolKeyword>(), PrimitiveType::Bool);
+        return _tree.add(Kind::PrimitiveType, PrimitiveType::Bool, consume<TokenType::BoolKeyword>(), {});
     }
 
     // TODO: Identifier, fully qualified names, generics, etc.
-    throw CompilerError(UnexpectedToken, span());
+    error(UnexpectedToken, span());
+    return noNode;
 }
 
-unique_ptr<FunctionArgument> rvm::Parser::consumeFunctionArgument() {
-    Token identifier;
+NodeId rvm::Parser::consumeFunctionArgument() {
+    unsigned int identifier = noToken;
     if (is<TokenType::Identifier>()) {
         identifier = consume<TokenType::Identifier>();
     }
     consume<TokenType::Colon>();
-    ptr_type type = parseTypeExpression();
+    NodeId type = parseTypeExpression();
 
-    return std::make_unique<FunctionArgument>(identifier, move(type));
+    return _tree.add(Kind::FunctionArgument, 0, identifier, { type });
 }
 
-unique_ptr<FunctionPrototype> rvm::Parser::consumeFunctionPrototype() {
-    vector<unique_ptr<FunctionArgument> > args;
+NodeId rvm::Parser::consumeFunctionPrototype() {
+    size_t args = _listItems.size();
 
-    consume<TokenType::OpenParenthesis>();
+    auto parenthesis = consume<TokenType::OpenParenthesis>();
     if (!is<TokenType::CloseParenthesis>()) {
-        args.push_back(consumeFunctionArgument());
+        _listItems.push_back(consumeFunctionArgument());
         while(is<TokenType::Comma>()) {
             consume<TokenType::Comma>();
-            args.push_back(consumeFunctionArgument());
+            _listItems.push_back(consumeFunctionArgument());
         }
     }
     consume<TokenType::CloseParenthesis>();
 
-    ptr_type returnTypeAnnotation = nullptr;
+    NodeId returnTypeAnnotation = noNode;
     if (is<TokenType::Colon>()) {
         consume<TokenType::Colon>();
         returnTypeAnnotation = parseTypeExpression();
     }
 
-    return std::make_unique<FunctionPrototype>(move(args), move(returnTypeAnnotation));
+    return makeList(Kind::FunctionPrototype, parenthesis, { returnTypeAnnotation }, args);
 }
 
-unique_ptr<Function> rvm::Parser::consumeFunction() {
-    auto functionKeywordToken = consume<TokenType::FunctionKeyword>();
+NodeId rvm::Parser::consumeFunction() {
+    consume<TokenType::FunctionKeyword>();
     auto identifier = consume<TokenType::Identifier>();
     auto proto = consumeFunctionPrototype();
+    if (_recovering) return noNode;
+    if (_deferBodies) {
+        size_t start = _index;
+        if (skipCodeBlock()) {
+            // The token range of the body is kept in two slots after the children.
+            auto function = _tree.add(Kind::Function, Tree::deferredBody, identifier, { proto, noNode, NodeId(start), NodeId(_index) });
+            _tree._nodes[function].count = 2;
+            _deferred.push_back(function);
+            return function;
+        }
+    }
     auto block = parseCodeBlock();
 
-    return std::make_unique<Function>(identifier, move(proto), move(block));
+    return _tree.add(Kind::Function, 0, identifier, { proto, block });
+}
+
+// Moves past the code block at the lookahead token, without building nodes.
+// Statements do not nest blocks, and neither they nor their error recovery go past a right brace,
+// so parseCodeBlock stops at the first one unless a member keyword or EoF ends the block before it.
+// Returns false and consumes nothing in those cases, the block is parsed right away like in eager mode.
+bool rvm::Parser::skipCodeBlock() {
+    if (!is<TokenType::LeftBrace>()) return false;
+    for (size_t index = _index + 1; ; index++) {
+        switch (_tokens.kind(index)) {
+            case TokenType::RightBrace:
+                _index = index;
+                consumeToken();
+                return true;
+            case TokenType::FunctionKeyword:
+            case TokenType::DeclareKeyword:
+            case TokenType::EoF:
+                return false;
+            default:
+                break;
+        }
+    }
+}
+
+// Parses the body skipped by skipCodeBlock, it ends at end like the eager parse would.
+NodeId rvm::Parser::parseDeferredCodeBlock(size_t start, size_t end) {
+    size_t index = _index;
+    bool recovering = _recovering;
+    _index = start;
+    _recovering = false;
+    NodeId block;
+    try {
+        block = parseCodeBlock();
+    } catch (...) {
+        _index = index;
+        _recovering = recovering;
+        throw;
+    }
+    assert(_index == end);
+    _index = index;
+    _recovering = recovering;
+    return block;
 }
 
-unique_ptr<FunctionDeclaration> rvm::Parser::consumeFunctionDeclaration(Token& declareKeyword) {
-    auto functionKeywordToken = consume<TokenType::FunctionKeyword>();
+NodeId rvm::ast::Tree::codeBlock(NodeId function) {
+    if (_nodeData[function].op == deferredBody) {
+        // Parsing grows the arrays, so the function's slots are found again after it.
+        NodeId block = _parser->parseDeferredCodeBlock(bodyStart(function), bodyEnd(function));
+        setCodeBlock(function, block);
+    }
+    return child(function, 1);
+}
+
+NodeId rvm::Parser::consumeFunctionDeclaration() {
+    consume<TokenType::FunctionKeyword>();
     auto identifier = consume<TokenType::Identifier>();
     auto proto = consumeFunctionPrototype();
-    auto semicolon = consume<TokenType::Semicolon>();
+    consume<TokenType::Semicolon>();
+
+    return _tree.add(Kind::FunctionDeclaration, 0, identifier, { proto });
+}
 
-    return std::make_unique<FunctionDeclaration>(identifier, move(proto));
+// <ModuleMember> ::= <Function> | declare <FunctionDeclaration>
+NodeId rvm::Parser::parseModuleMember() {
+    if (is<TokenType::FunctionKeyword>()) return consumeFunction();
+    if (is<TokenType::DeclareKeyword>()) {
+        consume<TokenType::DeclareKeyword>();
+        if (is<TokenType::FunctionKeyword>()) return consumeFunctionDeclaration();
+    }
+    error(UnexpectedToken, span());
+    return noNode;
 }
 
 void rvm::Parser::parseModuleMembers() {
     while(!is<TokenType::EoF>()) {
-        while(is<TokenType::Whitespace>()) consume<TokenType::Whitespace>();
-        if (is<TokenType::FunctionKeyword>()) {
-            _members.push_back(consumeFunction());
-        } else if (is<TokenType::DeclareKeyword>()) {
-            Token declareKeyword = consume<TokenType::DeclareKeyword>();
-            if (is<TokenType::FunctionKeyword>()) {
-                _members.push_back(consumeFunctionDeclaration(declareKeyword));
-            } else {
-                throw CompilerError(UnexpectedToken, span());
+        unsigned int start = (unsigned int)_index;
+        NodeId member = parseModuleMember();
+        if (_recovering) synchronizeMember();
+        else {
+            _members.push_back(member);
+            _memberTokens.push_back(start);
+        }
+    }
+}
+
+// Members are parsed with their bodies skipped, then the bodies are parsed in chunks of functions on the pool.
+// Each chunk builds its own Tree, once all succeeded their bodies are copied into the module's Tree in serial order.
+// Lexing errors still throw from the token buffer. On any error the partial parse is dropped and the caller parses serially,
+// so errors, recovery and the members that are kept are those of the serial parse, only error-free modules are parsed in parallel.
+bool rvm::Parser::parseModuleMembersInParallel() {
+    if (_pool->size() < 2) return false;
+
+    // Errors are only noted here, to be reported by the serial parse.
+    DiagnosticEngine* diagnostics = _diagnostics;
+    DiagnosticEngine dropped;
+    _diagnostics = &dropped;
+
+    bool parsed = true;
+    try {
+        _deferBodies = true;
+        parseModuleMembers();
+        _deferBodies = false;
+        parsed = !_failed;
+    } catch (CompilerError&) {
+        parsed = false;
+    }
+    _diagnostics = diagnostics;
+
+    if (parsed) {
+        size_t count = _deferred.size();
+        size_t chunks = min(count, _pool->size() * 4);
+        vector<Tree> trees;
+        trees.reserve(chunks);
+        for (size_t chunk = 0; chunk < chunks; chunk++) trees.emplace_back(&_tokens, nullptr);
+        vector<vector<NodeId>> blocks(chunks);
+        vector<char> failed(chunks, false);
+        try {
+            _pool->parallelFor(chunks, [&](size_t chunk) {
+                DiagnosticEngine dropped;
+                Parser parser(*this, &dropped);
+                for (size_t i = chunk * count / chunks, end = (chunk + 1) * count / chunks; i < end && !parser._failed; i++) {
+                    NodeId function = _deferred[i];
+                    blocks[chunk].push_back(parser.parseDeferredCodeBlock(_tree.bodyStart(function), _tree.bodyEnd(function)));
+                }
+                failed[chunk] = parser._failed;
+                trees[chunk] = move(parser._tree);
+            });
+        } catch (CompilerError&) {
+            parsed = false;
+        }
+        for (size_t chunk = 0; chunk < chunks; chunk++) parsed = parsed && !failed[chunk];
+
+        // The Tree is laid out again in the order the serial parse adds nodes: a member's prototype, its body, then
+        // the member, so every node has the id it has in the serial parse. Each member's nodes follow the previous member.
+        if (parsed) {
+            Tree tree(&_tokens, this);
+            NodeId next = 0;
+            size_t chunk = 0, index = 0;
+            for (auto& member : _members) {
+                NodeId first = next;
+                next = member + 1;
+                if (_tree.kind(member) != Kind::Function || _tree.isBodyParsed(member)) {
+                    member = tree.append(_tree, first, next) + (member - first);
+                    continue;
+                }
+                NodeId proto = tree.append(_tree, first, member) + (_tree.proto(member) - first);
+                // The bodies were parsed in member order, chunk after chunk.
+                if (index == blocks[chunk].size()) {
+                    chunk++;
+                    index = 0;
+                }
+                NodeId start = index == 0 ? 0 : blocks[chunk][index - 1] + 1;
+                NodeId block = tree.append(trees[chunk], start, blocks[chunk][index] + 1) + (blocks[chunk][index] - start);
+                member = tree.add(Kind::Function, 0, _tree._nodeData[member].token, { proto, block });
+                index++;
             }
+            _tree = move(tree);
+        }
+    }
+    _deferred.clear();
+    if (parsed) return true;
+
+    _index = 0;
+    _recovering = false;
+    _failed = false;
+    _deferBodies = false;
+    _members.clear();
+    _memberTokens.clear();
+    _listItems.clear();
+    _tree = Tree(&_tokens, this);
+    return false;
+}
+
+void rvm::Parser::edit(unsigned int offset, unsigned int removed, string_view inserted) {
+    if (offset > _source->size() || removed > _source->size() - offset) throw out_of_range("edit outside of the source");
+
+    // The first edit copies the code, the next ones edit it in place.
+    if (_ownSource == nullptr) _ownSource = make_unique<SourceBuffer>(string(_source->code()), _source->name());
+    const Char* previous = _source->begin();
+    _ownSource->replace(offset, removed, inserted);
+    _source = _ownSource.get();
+    if (reparseMembers(previous, offset, removed, (unsigned int)inserted.size())) return;
+
+    // As a new Parser for the edited code.
+    *_ownTokens = _pool != nullptr ? TokenBuffer(*_source, *_pool, _diagnostics) : TokenBuffer(*_source, _diagnostics);
+    _index = 0;
+    _recovering = false;
+    _failed = false;
+    _members.clear();
+    _memberTokens.clear();
+    _deferred.clear();
+    _listItems.clear();
+    _tree = Tree(&_tokens, this);
+    _generation++;
+    if (is<TokenType::EoF>()) _tokens.throwIfFailed();
+    parseModule(_deferBodies);
+}
+
+// Lexes and parses again, in the edited source, the members from the one before offset to the one after the removed characters, keeping the
+// tokens and nodes of the others. Since members parse the same wherever they are, the result is that of parsing the whole
+// edited code, as long as the edited members end where the next kept member starts.
+// Returns false when the whole module must be parsed instead: it was not parsed, it had errors, or the edited members
+// have errors or do not end at the next kept member. Once tokens are spliced the tokens and Tree are left to be rebuilt.
+bool rvm::Parser::reparseMembers(const Char* previous, unsigned int offset, unsigned int removed, unsigned int inserted) {
+    if (_failed || _tokens.failed() || _tokens._reported || _members.empty() || _index + 1 != _tokens.size()) return false;
+
+    // A member spans from its first token to the first token of the next, the first one from the start of the code.
+    auto memberAt = [this](unsigned int position) {
+        auto next = upper_bound(_memberTokens.begin() + 1, _memberTokens.end(), position, [this](unsigned int position, unsigned int token) {
+            return position < _tokens.location(token).offset;
+        });
+        return size_t(next - _memberTokens.begin()) - 1;
+    };
+    // The characters on both sides of the edit are in the window, tokens joined or split there are relexed.
+    size_t firstMember = memberAt(offset == 0 ? 0 : offset - 1);
+    size_t endMember = memberAt(offset + removed) + 1;
+    bool atEnd = endMember == _members.size();
+
+    size_t first = _memberTokens[firstMember];
+    size_t last = atEnd ? _tokens.size() - 1 : _memberTokens[endMember];
+    long long delta = (long long)inserted - removed;
+    unsigned int from = firstMember == 0 ? 0 : _tokens.location(first).offset;
+    unsigned int to = atEnd ? (unsigned int)_source->size() : (unsigned int)(_tokens.location(last).offset + delta);
+    size_t size = _tokens.size();
+    if (!_ownTokens->splice(previous, *_source, first, last, from, to, offset + removed, delta)) return false;
+
+    long long shift = (long long)_tokens.size() - (long long)size;
+    size_t end = size_t(last + shift);
+    if (shift != 0) {
+        _tree.moveTokens((unsigned int)last, shift);
+        for (size_t member = endMember; member < _members.size(); member++) _memberTokens[member] = (unsigned int)(_memberTokens[member] + shift);
+    }
+
+    // Errors are only noted here, to be reported by parsing the whole module.
+    DiagnosticEngine* diagnostics = _diagnostics;
+    DiagnosticEngine dropped;
+    _diagnostics = &dropped;
+    vector<NodeId> members;
+    vector<unsigned int> memberTokens;
+    _index = first;
+    try {
+        while (_index < end && !_recovering) {
+            memberTokens.push_back((unsigned int)_index);
+            members.push_back(parseModuleMember());
         }
-        else throw CompilerError(UnexpectedToken, span());
+    } catch (CompilerError&) {
+        _failed = true;
     }
+    _diagnostics = diagnostics;
+    if (_failed || _index != end) return false;
+
+    _members.erase(_members.begin() + firstMember, _members.begin() + endMember);
+    _members.insert(_members.begin() + firstMember, members.begin(), members.end());
+    _memberTokens.erase(_memberTokens.begin() + firstMember, _memberTokens.begin() + endMember);
+    _memberTokens.insert(_memberTokens.begin() + firstMember, memberTokens.begin(), memberTokens.end());
+    _index = _tokens.size() - 1;
+    return true;
 }
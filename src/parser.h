@@ -2,79 +2,240 @@
 #define RVM_PARSER_H
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <memory>
 #include "lexer.h"
+#include "tokenbuffer.h"
+#include "diagnostics.h"
 #include "ast.h"
 
 namespace rvm {
+    class ThreadPool;
+
     class Parser {
-        typedef typename rvm::Lexer::TokenIterator TokenIterator;
         typedef typename rvm::Lexer::Token Token;
 
-        rvm::Lexer _lexer;
-        TokenIterator _current;
-        TokenIterator _end;
-        Token _lookaheadToken;
-        std::vector<std::unique_ptr<ast::ModuleMember> > _members;
+        const rvm::SourceBuffer* _source;
+        // The code after an edit, null until the first one.
+        std::unique_ptr<rvm::SourceBuffer> _ownSource;
+        rvm::DiagnosticEngine* _diagnostics;
+        rvm::ThreadPool* _pool;
+        // Null for the parsers of a parallel parse, they read the tokens of the module's Parser.
+        std::unique_ptr<rvm::TokenBuffer> _ownTokens;
+        const rvm::TokenBuffer& _tokens;
+        size_t _index;
+        bool _deferBodies;
+        ast::Tree _tree;
+        std::vector<ast::NodeId> _members;
+        // The first token of each member. The members of a module parsed without errors cover all its tokens.
+        std::vector<unsigned int> _memberTokens;
+
+        // The functions whose bodies were skipped, in source order.
+        std::vector<ast::NodeId> _deferred;
+
+        // Child lists under construction, nested lists push on top and are copied to the Tree when complete.
+        std::vector<ast::NodeId> _listItems;
+
+        // An expression waiting for the one nested in it, see parseOperatorExpression.
+        struct ExpressionFrame {
+            enum class State : unsigned char {
+                // An operator expression extending its lhs, or waiting for the right operand of op,
+                // the rhs of an assignment, or the then and else expressions of a conditional.
+                Infix, Operand, Assignment, Then, Else,
+                // A prefix operator waiting for its operand.
+                Prefix,
+                // A primary expression in parentheses, and the arguments of an invocation of lhs.
+                Parenthesis, Argument,
+            };
+            State state;
+            unsigned char op;
+            unsigned int token;
+            unsigned int precedence;
+            ast::NodeId lhs;
+            ast::NodeId then;
+            size_t start;
+        };
+        std::vector<ExpressionFrame> _expressions;
+        unsigned int _maxNesting;
+
+        // Counts the edits that parsed the whole module again.
+        unsigned int _generation;
+
+        // Set from an error until the next synchronization point, errors in between are not reported.
+        bool _recovering;
+
+        // Set by the first error, reported or not.
+        bool _failed;
 
     public:
+        /// Expressions nested deeper are an ExpressionTooDeep error, so the passes walking them stay in bounds.
+        static const unsigned int defaultMaxNesting = 100000;
+
+        /// The Parser does not own source, it must outlive the Parser and the parsed members, or their first edit.
+        /// The Parser owns the AST, the Tree is freed with it.
+        /// Errors throw a CompilerError, unless diagnostics is given: then they are reported there and the
+        /// parser recovers at the next statement or member. Statements and members with errors are dropped.
+        Parser(const SourceBuffer& source, DiagnosticEngine* diagnostics = nullptr) :
+            _source(&source),
+            _diagnostics(diagnostics),
+            _pool(nullptr),
+            _ownTokens(std::make_unique<TokenBuffer>(source, diagnostics)),
+            _tokens(*_ownTokens),
+            _index(0),
+            _deferBodies(false),
+            _tree(&_tokens, this),
+            _maxNesting(defaultMaxNesting),
+            _generation(0),
+            _recovering(false),
+            _failed(false) {
+            if (is<TokenType::EoF>()) _tokens.throwIfFailed();
+        }
+
+        /// Lexes source in parallel on pool, and parseModule parses function bodies in parallel on it.
+        /// The members, errors and diagnostics are the same as parsing serially, and so are the Tree and its node ids.
+        Parser(const SourceBuffer& source, ThreadPool& pool, DiagnosticEngine* diagnostics = nullptr) :
+            _source(&source),
+            _diagnostics(diagnostics),
+            _pool(&pool),
+            _ownTokens(std::make_unique<TokenBuffer>(source, pool, diagnostics)),
+            _tokens(*_ownTokens),
+            _index(0),
+            _deferBodies(false),
+            _tree(&_tokens, this),
+            _maxNesting(defaultMaxNesting),
+            _generation(0),
+            _recovering(false),
+            _failed(false) {
+            if (is<TokenType::EoF>()) _tokens.throwIfFailed();
+        }
+
+        Parser(const Parser&) = delete;
+        Parser& operator=(const Parser&) = delete;
+
+        /// With deferBodies function bodies are skipped up to their right brace and parsed when
+        /// Tree::codeBlock is first called, then their errors are thrown or reported.
+        /// A body with a member keyword or EoF before its right brace is parsed right away.
+        void parseModule(bool deferBodies = false) {
+            _deferBodies = deferBodies;
+            if (!deferBodies && _pool != nullptr && parseModuleMembersInParallel()) return;
+            parseModuleMembers();
+        }
+
+        /// Sets how deep expressions may nest, each operand, parenthesized expression, argument and prefix operator nests one level.
+        /// Expressions are parsed with an explicit stack, so the limit is not bounded by the call stack.
+        void setMaxNesting(unsigned int depth) { _maxNesting = depth; }
+
+        /// Replaces removed characters at offset with inserted and parses the result, the same as a
+        /// new Parser for the edited code would, and members() lists the edited module's members.
+        /// The Parser owns the edited code, source() returns it.
+        ///
+        /// When the module had no errors only the members around the edit are lexed and parsed again,
+        /// if the edited code lexes and parses to the same member boundaries after them, so lexing and parsing
+        /// cost that of the edited function and the tokens and nodes after it are only moved when the number
+        /// of tokens changes. Nodes of the other members keep their ids, the replaced ones stay unused in the Tree.
+        /// Otherwise the whole module is lexed and parsed again, throwing or reporting its errors after
+        /// those reported before, clear the DiagnosticEngine first to keep only the edited module's.
+        /// Throws std::out_of_range if the removed characters are not all in the source.
+        void edit(unsigned int offset, unsigned int removed, std::string_view inserted);
+
+        /// Incremented by each edit that parsed the whole module again, node ids of one generation mean nothing in another.
+        unsigned int generation() const { return _generation; }
 
-        Parser(std::string code) :
-            _lexer(Lexer(code)),
-            _current(_lexer.begin()),
-            _end(_lexer.end()),
-            _lookaheadToken(*_current) {
+        const SourceBuffer& source() const { return *_source; }
+        const TokenBuffer& tokens() const { return _tokens; }
+
+        /// Reports the errors of the deferred bodies parsed from now on to diagnostics, and returns the engine they went to before,
+        /// so a caller can keep a body's errors apart and give the engine back. A Parser given no DiagnosticEngine keeps throwing.
+        DiagnosticEngine* setDiagnostics(DiagnosticEngine* diagnostics) {
+            DiagnosticEngine* previous = _diagnostics;
+            if (previous != nullptr) _diagnostics = diagnostics;
+            return previous;
         }
 
-        void parseModule() { parseModuleMembers(); }
-        std::vector<std::unique_ptr<ast::ModuleMember> >& members() { return _members; }
+        /// Whether an error was thrown or reported so far, deferred bodies count once they are parsed.
+        bool failed() const { return _failed; }
+
+        const std::vector<ast::NodeId>& members() const { return _members; }
+
+        /// The AST of the module, members index into it.
+        ast::Tree& tree() { return _tree; }
 
-        void visit(ast::ModuleMemberVisitor* visitor) {
-            for(auto& f : _members) f->visit(visitor);
+        template<typename Visitor>
+        void visit(Visitor* visitor) {
+            for(auto member : _members) visitor->visit(_tree, member);
         }
 
     private:
-        inline SourceSpan span() { return _lookaheadToken.span(); }
+        friend class ast::Tree;
+
+        /// A parser for the function bodies of module on another thread, with its own Tree.
+        Parser(const Parser& module, DiagnosticEngine* diagnostics) :
+            _source(module._source),
+            _diagnostics(diagnostics),
+            _pool(nullptr),
+            _tokens(module._tokens),
+            _index(0),
+            _deferBodies(false),
+            _tree(&module._tokens, nullptr),
+            _maxNesting(module._maxNesting),
+            _generation(0),
+            _recovering(false),
+            _failed(false) {}
+
+        inline SourceSpan span() { return _tokens.span(_index); }
 
         template<TokenType type>
-        inline bool is() { return _lookaheadToken == type; }
+        inline bool is() { return _tokens.kind(_index) == type; }
+
+        /// The kind of the token distance tokens after the lookahead token, peek(0) is the lookahead token.
+        inline TokenType peek(size_t distance) { return _tokens.kind(_index + distance); }
+
+        /// Throws, or reports the error and starts recovering.
+        void error(ErrorCode code, SourceSpan span);
 
         template<TokenType type>
-        inline void expect() {
-            if (!is<type>()) throw CompilerError(ErrorCode::UnexpectedToken, span());
+        inline bool expect() {
+            if (is<type>()) return true;
+            error(ErrorCode::UnexpectedToken, span());
+            return false;
         }
 
+        /// Consumes a token of type and returns its index, when recovering from a missing token
+        /// nothing is consumed and the index is ast::noToken.
         template<TokenType type>
-        inline Token consume() {
-            expect<type>();
+        inline unsigned int consume() {
+            if (!expect<type>()) return ast::noToken;
             return consumeToken();
         }
 
-        inline Token consumeToken();
-        ast::ptr_value parseValueExpression();
-        ast::ptr_value parsePrec1ValueExpression();
-        ast::ptr_value parsePrec2ValueExpression();
-        ast::ptr_value parsePrec3ValueExpression();
-        ast::ptr_value parsePrec4ValueExpression();
-        ast::ptr_value parsePrec5ValueExpression();
-        ast::ptr_value parsePrec6ValueExpression();
-        ast::ptr_value parsePrec7ValueExpression();
-        ast::ptr_value parsePrec8ValueExpression();
-        ast::ptr_value parsePrec9ValueExpression();
-        ast::ptr_value parsePrec10ValueExpression();
-        ast::ptr_value parsePrec11ValueExpression();
-        ast::ptr_value parsePrec12ValueExpression();
-        ast::ptr_value parsePrec13ValueExpression();
-        std::unique_ptr<ast::ConstStatement> parseConstStatement();
-        std::unique_ptr<ast::ReturnStatement> parseReturnStatement();
-        ast::ptr_statement parseStatement();
-        std::unique_ptr<ast::CodeBlock> parseCodeBlock();
-        ast::ptr_typeExp parseTypeExpression();
-        std::unique_ptr<ast::FunctionArgument> consumeFunctionArgument();
-        std::unique_ptr<ast::FunctionPrototype> consumeFunctionPrototype();
-        std::unique_ptr<ast::Function> consumeFunction();
-        std::unique_ptr<ast::FunctionDeclaration> consumeFunctionDeclaration(Token& declareKeyword);
+        /// Adds a node with the fixed children, followed by the items pushed on _listItems since start.
+        ast::NodeId makeList(ast::Kind kind, unsigned int token, std::initializer_list<ast::NodeId> children, size_t start) {
+            ast::NodeId node = _tree.add(kind, 0, token, children, _listItems.data() + start, _listItems.size() - start);
+            _listItems.resize(start);
+            return node;
+        }
+
+        inline unsigned int consumeToken();
+        void synchronizeStatement(size_t start);
+        void synchronizeMember();
+        ast::NodeId parseValueExpression();
+        ast::NodeId parseOperatorExpression(unsigned int precedence);
+        ast::NodeId parseConstStatement();
+        ast::NodeId parseReturnStatement();
+        ast::NodeId parseStatement();
+        ast::NodeId parseCodeBlock();
+        bool skipCodeBlock();
+        ast::NodeId parseDeferredCodeBlock(size_t start, size_t end);
+        ast::NodeId parseTypeExpression();
+        ast::NodeId consumeFunctionArgument();
+        ast::NodeId consumeFunctionPrototype();
+        ast::NodeId consumeFunction();
+        ast::NodeId consumeFunctionDeclaration();
+        ast::NodeId parseModuleMember();
         void parseModuleMembers();
+        bool parseModuleMembersInParallel();
+        bool reparseMembers(const Char* previous, unsigned int offset, unsigned int removed, unsigned int inserted);
     };
 };
 
@@ -5,44 +5,39 @@ using namespace std;
 using namespace rvm;
 using namespace rvm::ast;
 
-void ASTPrinter::on(Function* f) {
-    cout << "function " << f->name() << "(";
+void ASTPrinter::printPrototype(NodeId proto) {
+    cout << "(";
     bool firstArg = true;
-    for (auto& arg : f->proto()->args()) {
+    for (auto arg : _tree->args(proto)) {
         if (!firstArg) cout << ", ";
-        cout << arg->name() << ": ";
-        arg->typeAnnotation()->visit(this);
+        cout << _tree->name(arg) << ": ";
+        visit(_tree->typeAnnotation(arg));
         firstArg = false;
     }
     cout << ")";
 
-    if (f->proto()->returnTypeAnnotation()) {
+    if (_tree->returnTypeAnnotation(proto) != noNode) {
         cout << ": ";
-        f->proto()->returnTypeAnnotation()->visit(this);
+        visit(_tree->returnTypeAnnotation(proto));
     }
+}
+
+void ASTPrinter::onFunction(NodeId f) {
+    cout << "function " << _tree->name(f);
+    printPrototype(_tree->proto(f));
 
-    f->codeBlock()->visit(this);
+    NodeId block = _tree->codeBlock(f);
+    if (block != noNode) visit(block);
 }
 
-void ASTPrinter::on(FunctionDeclaration* f) {
-    cout << "declare function " << f->name() << "(";
-    bool firstArg = true;
-    for (auto& arg : f->proto()->args()) {
-        if (!firstArg) cout << ", ";
-        cout << arg->name() << ": ";
-        arg->typeAnnotation()->visit(this);
-        firstArg = false;
-    }
-    cout << ")";
-    if (f->proto()->returnTypeAnnotation()) {
-        cout << ": ";
-        f->proto()->returnTypeAnnotation()->visit(this);
-    }
+void ASTPrinter::onFunctionDeclaration(NodeId f) {
+    cout << "declare function " << _tree->name(f);
+    printPrototype(_tree->proto(f));
     cout << ";" << endl;
 }
 
-void ASTPrinter::on(PrimitiveTypeExpression* t) {
-    switch(t->type()) {
+void ASTPrinter::onPrimitiveType(NodeId t) {
+    switch(_tree->primitiveType(t)) {
         case PrimitiveType::Int:
             cout << "int";
             break;
@@ -59,88 +54,102 @@ void ASTPrinter::on(PrimitiveTypeExpression* t) {
 }
 
 // Statements
-void ASTPrinter::on(CodeBlock* statement) {
+void ASTPrinter::onCodeBlock(NodeId block) {
     cout << " {" << endl;
-    for (auto& statement : statement->statements()) {
-        statement->visit(this);
+    for (auto statement : _tree->statements(block)) {
+        visit(statement);
     }
     cout << "}" << endl;
 }
 
-void ASTPrinter::on(ConstStatement* statement) {
-    cout << "const " << statement->name();
-    ptr_typeExp& type = statement->typeAnnotation();
-    if (type != nullptr) {
+void ASTPrinter::onConstStatement(NodeId statement) {
+    cout << "const " << _tree->name(statement);
+    NodeId type = _tree->typeAnnotation(statement);
+    if (type != noNode) {
         cout << ": ";
-        type->visit(this);
+        visit(type);
     }
-    ptr_value& value = statement->value();
     cout << " = ";
-    value->visit(this);
+    visit(_tree->value(statement));
     cout << ";" << endl;
 }
 
-void ASTPrinter::on(ReturnStatement* statement) {
+void ASTPrinter::onReturnStatement(NodeId statement) {
     cout << "return";
-    ptr_value& value = statement->value();
-    if (value != nullptr) {
+    NodeId value = _tree->value(statement);
+    if (value != noNode) {
         cout << " ";
-        value->visit(this);
+        visit(value);
     }
     cout << ";" << endl;
 }
 
 // Value expressions
-void ASTPrinter::on(IdentifierExpression* expression) {
-    cout << expression->name();
+void ASTPrinter::onIdentifier(NodeId expression) {
+    cout << _tree->name(expression);
 }
 
-void ASTPrinter::on(ConstantValueExpression* expression) {
-    cout << expression->literal().code();
+void ASTPrinter::onConstantValue(NodeId expression) {
+    cout << _tree->token(expression).code(_source);
 }
 
-void ASTPrinter::on(MemberAccessExpression* expression) {
+void ASTPrinter::onMemberAccess(NodeId expression) {
     cout << "?";
 }
 
-void ASTPrinter::on(InvocationExpression* expression) {
-    expression->operand()->visit(this);
-    cout << "(";
-    bool isFirst = true;
-    for(auto& value : expression->values()) {
-        if (!isFirst) cout << ", ";
-        isFirst = false;
-        value->visit(this);
-    }
-    cout << ")";
+void ASTPrinter::onInvocation(NodeId expression) {
+    walk(expression);
 }
 
-void ASTPrinter::on(ConditionalIfExpression* expression) {
+void ASTPrinter::onConditionalIf(NodeId expression) {
     cout << "?";
 }
 
-void ASTPrinter::on(UnaryExpression* expression) {
-    switch(expression->op()) {
-        case UnaryOperator::ConditionalNotOperator: cout << "!"s; break;
-        case UnaryOperator::UnaryPlusOperator: cout << "+"s; break;
-        case UnaryOperator::UnaryMinusOperator: cout << "-"s; break;
-        case UnaryOperator::PreIncrementOperator: cout << "++"s; break;
-        case UnaryOperator::PreDecrementOperator: cout << "--"s; break;
-        case UnaryOperator::BitComplementOperator: cout << "~"s; break;
-        default:;
-    }
+void ASTPrinter::onUnary(NodeId expression) {
+    walk(expression);
+}
 
-    expression->operand()->visit(this);
+void ASTPrinter::onBinary(NodeId expression) {
+    walk(expression);
+}
 
-    switch(expression->op()) {
-        case UnaryOperator::PostIncrementOperator: cout << "++"s; break;
-        case UnaryOperator::PostDecrementOperator: cout << "--"s; break;
-        default:;
+// Operators and invocations are walked, so generated expressions print however deep they nest.
+bool ASTPrinter::enter(NodeId node) {
+    switch (_tree->kind(node)) {
+        case Kind::Unary:
+            switch(_tree->unaryOperator(node)) {
+                case UnaryOperator::ConditionalNotOperator: cout << "!"s; break;
+                case UnaryOperator::UnaryPlusOperator: cout << "+"s; break;
+                case UnaryOperator::UnaryMinusOperator: cout << "-"s; break;
+                case UnaryOperator::PreIncrementOperator: cout << "++"s; break;
+                case UnaryOperator::PreDecrementOperator: cout << "--"s; break;
+                case UnaryOperator::BitComplementOperator: cout << "~"s; break;
+                default:;
+            }
+            return true;
+        case Kind::Binary:
+        case Kind::Invocation:
+            return true;
+        default:
+            visit(node);
+            return false;
     }
 }
 
-void ASTPrinter::on(BinaryExpression* expression) {
-    expression->lhs()->visit(this);
-    cout << " "s << toString(expression->op()) << " "s;
-    expression->rhs()->visit(this);
+void ASTPrinter::between(NodeId node, size_t index) {
+    if (_tree->kind(node) == Kind::Binary) cout << " "s << toString(_tree->binaryOperator(node)) << " "s;
+    else if (_tree->kind(node) == Kind::Invocation) cout << (index == 1 ? "(" : ", ");
+}
+
+void ASTPrinter::leave(NodeId node) {
+    if (_tree->kind(node) == Kind::Unary) {
+        switch(_tree->unaryOperator(node)) {
+            case UnaryOperator::PostIncrementOperator: cout << "++"s; break;
+            case UnaryOperator::PostDecrementOperator: cout << "--"s; break;
+            default:;
+        }
+    } else if (_tree->kind(node) == Kind::Invocation) {
+        if (_tree->values(node).size() == 0) cout << "(";
+        cout << ")";
+    }
 }
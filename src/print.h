@@ -2,26 +2,34 @@
 #define RVM_PRINT_H
 
 #include "ast.h"
+#include "source.h"
 
 namespace rvm {
-    class ASTPrinter :
-        public rvm::ast::ModuleMemberVisitor,
-        public rvm::ast::TypeExpressionVisitor,
-        public rvm::ast::StatementVisitor {
+    class ASTPrinter : public rvm::ast::Visitor<ASTPrinter> {
+        const rvm::SourceBuffer& _source;
+
+        void printPrototype(rvm::ast::NodeId proto);
+
     public:
-        void on(rvm::ast::Function* f) override;
-        void on(rvm::ast::FunctionDeclaration* f) override;
-        void on(rvm::ast::PrimitiveTypeExpression* t) override;
-        void on(rvm::ast::CodeBlock* statement) override;
-        void on(rvm::ast::ConstStatement* statement) override;
-        void on(rvm::ast::ReturnStatement* statement) override;
-        void on(rvm::ast::IdentifierExpression* expression) override;
-        void on(rvm::ast::ConstantValueExpression* expression) override;
-        void on(rvm::ast::MemberAccessExpression* expression) override;
-        void on(rvm::ast::InvocationExpression* expression) override;
-        void on(rvm::ast::ConditionalIfExpression* expression) override;
-        void on(rvm::ast::UnaryExpression* expression) override;
-        void on(rvm::ast::BinaryExpression* expression) override;
+        ASTPrinter(const rvm::SourceBuffer& source) : _source(source) {}
+
+        void onFunction(rvm::ast::NodeId f);
+        void onFunctionDeclaration(rvm::ast::NodeId f);
+        void onPrimitiveType(rvm::ast::NodeId t);
+        void onCodeBlock(rvm::ast::NodeId statement);
+        void onConstStatement(rvm::ast::NodeId statement);
+        void onReturnStatement(rvm::ast::NodeId statement);
+        void onIdentifier(rvm::ast::NodeId expression);
+        void onConstantValue(rvm::ast::NodeId expression);
+        void onMemberAccess(rvm::ast::NodeId expression);
+        void onInvocation(rvm::ast::NodeId expression);
+        void onConditionalIf(rvm::ast::NodeId expression);
+        void onUnary(rvm::ast::NodeId expression);
+        void onBinary(rvm::ast::NodeId expression);
+
+        bool enter(rvm::ast::NodeId node);
+        void between(rvm::ast::NodeId node, size_t index);
+        void leave(rvm::ast::NodeId node);
     };
 };
 
@@ -0,0 +1,293 @@
+#include <algorithm>
+#include <cassert>
+#include <unordered_set>
+
+#include "query.h"
+#include "parser.h"
+
+using namespace std;
+using namespace rvm;
+using namespace rvm::ast;
+
+rvm::QueryEngine::QueryEngine(Parser* module, Binder* binder, DiagnosticEngine* diagnostics, rvm::type::TypeContext* types) :
+    _module(module),
+    _binder(binder),
+    _diagnostics(diagnostics),
+    _checker(binder, diagnostics, types),
+    _runs(0),
+    _generation(module->generation()) {
+    _checker._queries = this;
+    for (auto member : module->members()) _members.push_back(record(member));
+}
+
+QueryEngine::Member rvm::QueryEngine::record(NodeId member) {
+    Tree& tree = _module->tree();
+    return { member, tree.kind(member), tree.name(member) };
+}
+
+// The Binder binds functions and function declarations.
+void rvm::QueryEngine::bind(const Member& member) {
+    if (member.kind == Kind::Function || member.kind == Kind::FunctionDeclaration) _binder->addSymbolDeclaration(member.name, member.node);
+}
+
+void rvm::QueryEngine::unbind(const Member& member) {
+    if (member.kind == Kind::Function || member.kind == Kind::FunctionDeclaration) _binder->removeSymbolDeclaration(member.name, member.node);
+}
+
+QueryEngine::Query& rvm::QueryEngine::ask(QueryKey key, bool& run) {
+    auto inserted = _queries.try_emplace(key, Query { State::Running, false, nullptr, {}, {}, {}, 0 });
+    Query& query = inserted.first->second;
+    run = inserted.second;
+
+    if (!_active.empty()) {
+        auto& dependencies = _queries.find(_active.back())->second.dependencies;
+        if (find(dependencies.begin(), dependencies.end(), key) == dependencies.end()) {
+            dependencies.push_back(key);
+            query.dependents.push_back(_active.back());
+        }
+    }
+
+    if (run) {
+        _active.push_back(key);
+        return query;
+    }
+
+    // Bodies ask for call signatures, which ask for signatures, which ask for nothing, so no query is asked while it runs.
+    assert(query.state == State::Done);
+    if (query.failed && !_active.empty()) _queries.find(_active.back())->second.failed = true;
+    return query;
+}
+
+template<typename Compute>
+void rvm::QueryEngine::run(QueryKey key, Query& query, Compute compute) {
+    // A Body query parses a deferred body, its syntax errors are kept before its type errors.
+    // Only Body queries parse, and none runs inside another, so the Parser's own engine is the one swapped out.
+    DiagnosticEngine parsed, checked;
+    DiagnosticEngine* syntax = key.kind == QueryKey::Kind::Body ? _module->setDiagnostics(&parsed) : nullptr;
+    DiagnosticEngine* outer = _checker._diagnostics;
+    if (_diagnostics != nullptr) _checker._diagnostics = &checked;
+    auto restore = [&] {
+        _checker._diagnostics = outer;
+        if (key.kind == QueryKey::Kind::Body) _module->setDiagnostics(syntax);
+    };
+    try {
+        compute();
+    } catch (...) {
+        restore();
+        abandon(key);
+        throw;
+    }
+    restore();
+
+    query.diagnostics = parsed.diagnostics();
+    for (auto& diagnostic : query.diagnostics) syntax->report(diagnostic.code, diagnostic.span);
+    for (auto& diagnostic : checked.diagnostics()) {
+        query.diagnostics.push_back(diagnostic);
+        _diagnostics->report(diagnostic.code, diagnostic.span);
+    }
+    if (key.kind != QueryKey::Kind::CallSignatures) query.offset = _module->tree().span(static_cast<NodeId>(key.subject)).start.offset;
+    query.state = State::Done;
+    query.failed = query.failed || !query.diagnostics.empty();
+    _active.pop_back();
+    if (query.failed && !_active.empty()) _queries.find(_active.back())->second.failed = true;
+    _runs++;
+}
+
+// Forgets the running query when it threw, so it runs again when asked again.
+void rvm::QueryEngine::abandon(QueryKey key) {
+    _active.pop_back();
+    forget(key);
+}
+
+void rvm::QueryEngine::forget(QueryKey key) {
+    auto query = _queries.find(key);
+    if (query == _queries.end()) return;
+    for (auto& dependency : query->second.dependencies) {
+        auto asked = _queries.find(dependency);
+        if (asked == _queries.end()) continue;
+        auto& dependents = asked->second.dependents;
+        dependents.erase(std::remove(dependents.begin(), dependents.end(), key), dependents.end());
+    }
+    _queries.erase(query);
+}
+
+rvm::type::SignatureType* rvm::QueryEngine::signature(NodeId member) {
+    QueryKey key { QueryKey::Kind::Signature, member };
+    bool run;
+    Query& query = ask(key, run);
+    if (run) this->run(key, query, [&] { query.signature = _checker.signature(_module->tree(), member); });
+    return query.signature;
+}
+
+const rvm::type::OverloadSet& rvm::QueryEngine::callSignatures(Atom name) {
+    static const rvm::type::OverloadSet none;
+    Symbol* symbol = _binder->lookup(name);
+
+    QueryKey key { QueryKey::Kind::CallSignatures, name.id() };
+    bool run;
+    Query& query = ask(key, run);
+    if (run) {
+        this->run(key, query, [&] {
+            if (symbol == nullptr) return;
+            symbol->clearCallSignatures();
+            Tree& tree = _module->tree();
+            for (auto declaration : symbol->declarations()) {
+                auto kind = tree.kind(declaration);
+                if (kind != Kind::Function && kind != Kind::FunctionDeclaration) continue;
+                auto signature = this->signature(declaration);
+                if (signature != nullptr) symbol->addCallSignature(signature);
+            }
+        });
+    }
+    return symbol != nullptr ? symbol->callSignatures() : none;
+}
+
+bool rvm::QueryEngine::checkBody(NodeId function) {
+    QueryKey key { QueryKey::Kind::Body, function };
+    bool run;
+    Query& query = ask(key, run);
+    if (run) {
+        this->run(key, query, [&] {
+            signature(function);
+            _checker.body(_module->tree(), function);
+        });
+    }
+    return !query.failed;
+}
+
+rvm::type::Type* rvm::QueryEngine::type(NodeId function, NodeId expression) {
+    checkBody(function);
+    return _module->tree().type(expression);
+}
+
+bool rvm::QueryEngine::checkReachable(Atom name) {
+    Symbol* root = _binder->lookup(name);
+    if (root == nullptr) return false;
+
+    // The bodies reference Symbols through their call signature queries, their functions are reached next.
+    Tree& tree = _module->tree();
+    vector<NodeId> pending;
+    unordered_set<NodeId> reached;
+    auto reach = [&](Symbol* symbol) {
+        if (symbol == nullptr) return;
+        for (auto declaration : symbol->declarations()) {
+            if (tree.kind(declaration) == Kind::Function && reached.insert(declaration).second) pending.push_back(declaration);
+        }
+    };
+    reach(root);
+    if (pending.empty()) return false;
+
+    bool typed = true;
+    while (!pending.empty()) {
+        NodeId function = pending.back();
+        pending.pop_back();
+        typed = checkBody(function) && typed;
+        for (auto& dependency : dependencies({ QueryKey::Kind::Body, function })) {
+            if (dependency.kind == QueryKey::Kind::CallSignatures) reach(_binder->lookup(Atom(static_cast<unsigned int>(dependency.subject))));
+        }
+    }
+    return typed;
+}
+
+bool rvm::QueryEngine::checkAll() {
+    Tree& tree = _module->tree();
+    bool typed = true;
+    for (auto member : _module->members()) {
+        if (tree.kind(member) == Kind::Function) typed = checkBody(member) && typed;
+    }
+    return typed;
+}
+
+void rvm::QueryEngine::update() {
+    // An incremental edit replaces a run of members and keeps the node ids of the others,
+    // so the members before and after the run are found by comparing ids from both ends.
+    auto& members = _module->members();
+    bool rebuilt = _module->generation() != _generation;
+    size_t prefix = 0, suffix = 0;
+    if (!rebuilt) {
+        while (prefix < _members.size() && prefix < members.size() && _members[prefix].node == members[prefix]) prefix++;
+        while (suffix < _members.size() - prefix && suffix < members.size() - prefix
+            && _members[_members.size() - 1 - suffix].node == members[members.size() - 1 - suffix]) suffix++;
+    }
+
+    vector<unsigned int> names;
+    vector<Member> added;
+    for (size_t i = prefix; i < _members.size() - suffix; i++) {
+        unbind(_members[i]);
+        names.push_back(_members[i].name.id());
+        forget({ QueryKey::Kind::Signature, _members[i].node });
+        forget({ QueryKey::Kind::Body, _members[i].node });
+    }
+    for (size_t i = prefix; i < members.size() - suffix; i++) {
+        added.push_back(record(members[i]));
+        bind(added.back());
+        names.push_back(added.back().name.id());
+    }
+    _members.erase(_members.begin() + prefix, _members.end() - suffix);
+    _members.insert(_members.begin() + prefix, added.begin(), added.end());
+    _generation = _module->generation();
+
+    if (rebuilt) {
+        _queries.clear();
+        _checker._calls.clear();
+        return;
+    }
+
+    // The members after the edit moved whole, their diagnostics move with them.
+    for (size_t i = _members.size() - suffix; i < _members.size(); i++) {
+        for (auto kind : { QueryKey::Kind::Signature, QueryKey::Kind::Body }) {
+            auto query = _queries.find({ kind, _members[i].node });
+            if (query == _queries.end() || query->second.diagnostics.empty()) continue;
+            unsigned int offset = _module->tree().span(_members[i].node).start.offset;
+            unsigned int delta = offset - query->second.offset;
+            for (auto& diagnostic : query->second.diagnostics) {
+                diagnostic.span.start.offset += delta;
+                diagnostic.span.end.offset += delta;
+            }
+            query->second.offset = offset;
+        }
+    }
+
+    // The names whose declarations changed are answered again if they were asked for,
+    // when their signatures changed the bodies that asked for them are checked again.
+    sort(names.begin(), names.end());
+    names.erase(unique(names.begin(), names.end()), names.end());
+    bool changed = false;
+    for (auto name : names) {
+        QueryKey key { QueryKey::Kind::CallSignatures, name };
+        auto query = _queries.find(key);
+        if (query == _queries.end()) continue;
+        vector<QueryKey> dependents = move(query->second.dependents);
+        forget(key);
+
+        Symbol* symbol = _binder->lookup(Atom(name));
+        vector<rvm::type::SignatureType*> before;
+        if (symbol != nullptr) before = symbol->callSignatures().signatures();
+        if (callSignatures(Atom(name)).signatures() == before) {
+            _queries.find(key)->second.dependents = move(dependents);
+            continue;
+        }
+        changed = true;
+        for (auto& dependent : dependents) forget(dependent);
+    }
+
+    // Calls resolved against the changed signatures are resolved again, in the bodies that are checked again.
+    if (changed) _checker._calls.clear();
+}
+
+void rvm::QueryEngine::report(DiagnosticEngine& diagnostics) const {
+    for (auto& query : _queries) {
+        for (auto& diagnostic : query.second.diagnostics) diagnostics.report(diagnostic.code, diagnostic.span);
+    }
+}
+
+const vector<QueryKey>& rvm::QueryEngine::dependencies(QueryKey key) const {
+    static const vector<QueryKey> none;
+    auto query = _queries.find(key);
+    return query != _queries.end() ? query->second.dependencies : none;
+}
+
+bool rvm::QueryEngine::answered(QueryKey key) const {
+    auto query = _queries.find(key);
+    return query != _queries.end() && query->second.state == State::Done;
+}
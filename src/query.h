@@ -0,0 +1,160 @@
+#ifndef RVM_QUERY_H
+#define RVM_QUERY_H
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include "atom.h"
+#include "ast.h"
+#include "types.h"
+#include "binder.h"
+#include "typechecker.h"
+#include "diagnostics.h"
+
+namespace rvm {
+    class Parser;
+
+    /// A question the QueryEngine answers once and remembers.
+    struct QueryKey {
+        enum class Kind : unsigned char {
+            /// The SignatureType of a function or function declaration, subject is its NodeId.
+            Signature,
+            /// The call signatures of the Symbol of a name, the signatures of all its declarations, subject is the Atom id.
+            CallSignatures,
+            /// Whether the body of a function is well typed, subject is its NodeId.
+            Body,
+        };
+
+        Kind kind;
+        uintptr_t subject;
+
+        bool operator == (const QueryKey& other) const { return kind == other.kind && subject == other.subject; }
+    };
+
+    struct QueryKeyHash {
+        size_t operator()(const QueryKey& key) const { return static_cast<size_t>((key.subject * 0x9E3779B97F4A7C15ULL) ^ static_cast<size_t>(key.kind)); }
+    };
+
+    /// Type checks a module on demand: each answer is computed by a query the first time it is asked,
+    /// remembered, and records the queries it asked in turn. Checking a body asks for the call signatures
+    /// of the names it references, which ask for the signatures of their declarations, so only what
+    /// a body uses is checked and checkReachable checks only the functions reachable from a root.
+    ///
+    /// After Parser::edit, update drops the answers the edit made stale: those of removed members, and the bodies
+    /// depending on a name whose call signatures changed. The other answers are reused, so checking the edited module
+    /// again checks the edited functions and the bodies calling functions whose signatures changed.
+    ///
+    /// Errors throw a CompilerError, unless diagnostics is given: then they are reported there once,
+    /// when the query that finds them runs, and a query that reported an error answers false or the error type.
+    /// The syntax errors of a deferred body are found by its Body query and reported where the Parser reports.
+    class QueryEngine {
+        enum class State : unsigned char {
+            Running,
+            Done,
+        };
+
+        struct Query {
+            State state;
+            // Set when the query or one it asked reported an error.
+            bool failed;
+            rvm::type::SignatureType* signature;
+            std::vector<QueryKey> dependencies;
+            // The queries that asked for this one, so update finds the bodies to check again without a scan.
+            std::vector<QueryKey> dependents;
+            // The errors the query reported itself, with the syntax errors of the body a Body query parsed,
+            // kept to report the module's errors again after an update.
+            std::vector<Diagnostic> diagnostics;
+            // Where the member of a Signature or Body query started when its diagnostics were last placed,
+            // kept members move whole, so update moves their diagnostics with them.
+            unsigned int offset;
+        };
+
+        struct Member {
+            ast::NodeId node;
+            // The kind and name when the member was bound, a removed member's tokens and nodes may be gone.
+            ast::Kind kind;
+            Atom name;
+        };
+
+        Parser* _module;
+        Binder* _binder;
+        DiagnosticEngine* _diagnostics;
+        TypeChecker _checker;
+
+        std::unordered_map<QueryKey, Query, QueryKeyHash> _queries;
+        // The queries running, the last one asked the current one.
+        std::vector<QueryKey> _active;
+        size_t _runs;
+
+        // The members bound, and the Parser generation of their node ids.
+        std::vector<Member> _members;
+        unsigned int _generation;
+
+        // The query for key, recorded as a dependency of the running query. run is set when it has to run now,
+        // then it is running until run completes it or abandon drops it.
+        Query& ask(QueryKey key, bool& run);
+        // Runs compute for the running query key, its errors are kept in the query and then reported.
+        template<typename Compute>
+        void run(QueryKey key, Query& query, Compute compute);
+        void abandon(QueryKey key);
+        // Drops the answer for key and its edges.
+        void forget(QueryKey key);
+
+        Member record(ast::NodeId member);
+        void bind(const Member& member);
+        void unbind(const Member& member);
+
+    public:
+        /// The module must be bound by binder, types are interned in types or in a TypeContext of the engine's own.
+        QueryEngine(Parser* module, Binder* binder, DiagnosticEngine* diagnostics = nullptr, rvm::type::TypeContext* types = nullptr);
+        QueryEngine(const QueryEngine&) = delete;
+        QueryEngine& operator=(const QueryEngine&) = delete;
+
+        /// The signature of a function or function declaration, the prototype types are set in the Tree.
+        rvm::type::SignatureType* signature(ast::NodeId member);
+
+        /// The call signatures of the Symbol named name, after the signatures of all its declarations were added to it.
+        /// Empty when no function has the name.
+        const rvm::type::OverloadSet& callSignatures(Atom name);
+
+        /// Type checks the body of function, the types of its expressions are set in the Tree.
+        /// Returns whether it and the queries it asked reported no errors.
+        bool checkBody(ast::NodeId function);
+
+        /// The type of expression in the body of function, checking the body first.
+        rvm::type::Type* type(ast::NodeId function, ast::NodeId expression);
+
+        /// Checks the bodies of the functions named name and of every function their bodies reference, transitively.
+        /// Returns whether all of them are well typed, false when no function has the name.
+        bool checkReachable(Atom name);
+
+        /// Checks the bodies of all functions of the module, returns whether all of them are well typed.
+        bool checkAll();
+
+        /// Brings the Binder and the answers up to date with the module after Parser::edit.
+        /// Members the edit removed are unbound and their answers dropped, the members it added are bound.
+        /// The call signatures of their names are answered again, and if they changed the bodies that asked for them are dropped.
+        /// When the edit parsed the whole module again all answers are dropped.
+        void update();
+
+        /// Reports the errors of all the answers kept, the errors of the module as checked so far, in no particular order.
+        /// They include the syntax errors of the deferred bodies checked, not those the Parser reported while parsing the module.
+        void report(DiagnosticEngine& diagnostics) const;
+
+        /// The queries key asked for when it ran, empty if it has not run.
+        const std::vector<QueryKey>& dependencies(QueryKey key) const;
+
+        /// Whether the query for key has run.
+        bool answered(QueryKey key) const;
+
+        /// The number of queries answered or running.
+        size_t size() const { return _queries.size(); }
+
+        /// The number of queries run since the QueryEngine was created.
+        size_t runs() const { return _runs; }
+
+        rvm::type::TypeContext& types() { return _checker.types(); }
+    };
+};
+
+#endif
@@ -0,0 +1,368 @@
+#include "scan.h"
+#include "lexertables.h"
+
+// SSE2 is part of x86-64, so its kernels run on any x86-64 CPU and only AVX2 is checked at run time.
+// 32-bit x86 builds do not assume SSE2 and use the scalar kernels.
+#if defined(__x86_64__) || defined(_M_X64)
+#define RVM_SCAN_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define RVM_TARGET_AVX2
+#else
+#define RVM_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+using namespace rvm;
+using namespace rvm::lexer;
+using namespace rvm::scan;
+
+namespace {
+    // The length of the valid UTF-8 sequence at p, or 0 if it is invalid or truncated by end.
+    // Overlong encodings, surrogates and code points above U+10FFFF are invalid.
+    inline size_t utf8SequenceLength(const unsigned char* p, const unsigned char* end) {
+        unsigned char lead = p[0];
+        if (lead < 0x80) return 1;
+
+        size_t length;
+        unsigned char low = 0x80, high = 0xBF;
+        if (lead >= 0xC2 && lead <= 0xDF) length = 2;
+        else if (lead >= 0xE0 && lead <= 0xEF) length = 3;
+        else if (lead >= 0xF0 && lead <= 0xF4) length = 4;
+        else return 0;
+        if (static_cast<size_t>(end - p) < length) return 0;
+
+        if (lead == 0xE0) low = 0xA0;
+        else if (lead == 0xED) high = 0x9F;
+        else if (lead == 0xF0) low = 0x90;
+        else if (lead == 0xF4) high = 0x8F;
+        if (p[1] < low || p[1] > high) return 0;
+        for (size_t i = 2; i < length; i++) {
+            if ((p[i] & 0xC0) != 0x80) return 0;
+        }
+        return length;
+    }
+
+    const Char* findInvalidUtf8Scalar(const Char* begin, const Char* end) {
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(begin);
+        const unsigned char* last = reinterpret_cast<const unsigned char*>(end);
+        while (p < last) {
+            size_t length = utf8SequenceLength(p, last);
+            if (length == 0) return reinterpret_cast<const Char*>(p);
+            p += length;
+        }
+        return end;
+    }
+
+#if !RVM_SCAN_X86
+    // Scalar kernels, used when no SIMD is available.
+
+    const Char* skipWhitespaceScalar(const Char* p) {
+        while (is(*p, WhitespaceClass)) p++;
+        return p;
+    }
+
+    const Char* skipIdentifierTailScalar(const Char* p) {
+        while (is(*p, IdentifierTailClass)) p++;
+        return p;
+    }
+
+    const Char* skipStringBodyScalar(const Char* p, Char terminator) {
+        while (*p != terminator && *p != '\\' && *p != '\r' && *p != '\n' && *p != 0) p++;
+        return p;
+    }
+#endif
+
+#if RVM_SCAN_X86
+    inline unsigned int countTrailingZeros(unsigned int mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return index;
+#else
+        return __builtin_ctz(mask);
+#endif
+    }
+
+    // SSE2 kernels, SSE2 is part of the x86-64 baseline.
+
+    const Char* skipWhitespaceSSE2(const Char* p) {
+        const __m128i space = _mm_set1_epi8(' ');
+        const __m128i tab = _mm_set1_epi8('\t');
+        const __m128i lf = _mm_set1_epi8('\n');
+        const __m128i cr = _mm_set1_epi8('\r');
+        for (;; p += 16) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            __m128i whitespace = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab)),
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, lf), _mm_cmpeq_epi8(chunk, cr)));
+            unsigned int stop = ~static_cast<unsigned int>(_mm_movemask_epi8(whitespace)) & 0xFFFF;
+            if (stop) return p + countTrailingZeros(stop);
+        }
+    }
+
+    const Char* skipIdentifierTailSSE2(const Char* p) {
+        const __m128i caseBit = _mm_set1_epi8(0x20);
+        const __m128i beforeA = _mm_set1_epi8('a' - 1);
+        const __m128i afterZ = _mm_set1_epi8('z' + 1);
+        const __m128i before0 = _mm_set1_epi8('0' - 1);
+        const __m128i after9 = _mm_set1_epi8('9' + 1);
+        const __m128i underscore = _mm_set1_epi8('_');
+        for (;; p += 16) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            __m128i lower = _mm_or_si128(chunk, caseBit);
+            __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(lower, beforeA), _mm_cmplt_epi8(lower, afterZ));
+            __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(chunk, before0), _mm_cmplt_epi8(chunk, after9));
+            __m128i tail = _mm_or_si128(_mm_or_si128(letter, digit), _mm_cmpeq_epi8(chunk, underscore));
+            unsigned int stop = ~static_cast<unsigned int>(_mm_movemask_epi8(tail)) & 0xFFFF;
+            if (stop) return p + countTrailingZeros(stop);
+        }
+    }
+
+    const Char* skipStringBodySSE2(const Char* p, Char terminator) {
+        const __m128i quote = _mm_set1_epi8(terminator);
+        const __m128i backslash = _mm_set1_epi8('\\');
+        const __m128i lf = _mm_set1_epi8('\n');
+        const __m128i cr = _mm_set1_epi8('\r');
+        const __m128i zero = _mm_setzero_si128();
+        for (;; p += 16) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            __m128i special = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+                _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, lf), _mm_cmpeq_epi8(chunk, cr)), _mm_cmpeq_epi8(chunk, zero)));
+            unsigned int stop = static_cast<unsigned int>(_mm_movemask_epi8(special));
+            if (stop) return p + countTrailingZeros(stop);
+        }
+    }
+
+    // ASCII blocks are skipped 16 characters at a time, blocks with other characters are validated by sequence.
+    const Char* findInvalidUtf8SSE2(const Char* p, const Char* end) {
+        const unsigned char* last = reinterpret_cast<const unsigned char*>(end);
+        while (p < end) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            if (_mm_movemask_epi8(chunk) == 0) {
+                p += 16;
+                continue;
+            }
+            const Char* blockEnd = p + 16;
+            while (p < blockEnd && p < end) {
+                size_t length = utf8SequenceLength(reinterpret_cast<const unsigned char*>(p), last);
+                if (length == 0) return p;
+                p += length;
+            }
+        }
+        return end;
+    }
+
+    // AVX2 kernels, only called after checking the CPU supports AVX2.
+
+    RVM_TARGET_AVX2 const Char* skipWhitespaceAVX2(const Char* p) {
+        const __m256i space = _mm256_set1_epi8(' ');
+        const __m256i tab = _mm256_set1_epi8('\t');
+        const __m256i lf = _mm256_set1_epi8('\n');
+        const __m256i cr = _mm256_set1_epi8('\r');
+        for (;; p += 32) {
+            __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            __m256i whitespace = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(chunk, space), _mm256_cmpeq_epi8(chunk, tab)),
+                _mm256_or_si256(_mm256_cmpeq_epi8(chunk, lf), _mm256_cmpeq_epi8(chunk, cr)));
+            unsigned int stop = ~static_cast<unsigned int>(_mm256_movemask_epi8(whitespace));
+            if (stop) return p + countTrailingZeros(stop);
+        }
+    }
+
+    RVM_TARGET_AVX2 const Char* skipIdentifierTailAVX2(const Char* p) {
+        const __m256i caseBit = _mm256_set1_epi8(0x20);
+        const __m256i beforeA = _mm256_set1_epi8('a' - 1);
+        const __m256i afterZ = _mm256_set1_epi8('z' + 1);
+        const __m256i before0 = _mm256_set1_epi8('0' - 1);
+        const __m256i after9 = _mm256_set1_epi8('9' + 1);
+        const __m256i underscore = _mm256_set1_epi8('_');
+        for (;; p += 32) {
+            __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            __m256i lower = _mm256_or_si256(chunk, caseBit);
+            __m256i letter = _mm256_and_si256(_mm256_cmpgt_epi8(lower, beforeA), _mm256_cmpgt_epi8(afterZ, lower));
+            __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(chunk, before0), _mm256_cmpgt_epi8(after9, chunk));
+            __m256i tail = _mm256_or_si256(_mm256_or_si256(letter, digit), _mm256_cmpeq_epi8(chunk, underscore));
+            unsigned int stop = ~static_cast<unsigned int>(_mm256_movemask_epi8(tail));
+            if (stop) return p + countTrailingZeros(stop);
+        }
+    }
+
+    RVM_TARGET_AVX2 const Char* skipStringBodyAVX2(const Char* p, Char terminator) {
+        const __m256i quote = _mm256_set1_epi8(terminator);
+        const __m256i backslash = _mm256_set1_epi8('\\');
+        const __m256i lf = _mm256_set1_epi8('\n');
+        const __m256i cr = _mm256_set1_epi8('\r');
+        const __m256i zero = _mm256_setzero_si256();
+        for (;; p += 32) {
+            __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            __m256i special = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash)),
+                _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, lf), _mm256_cmpeq_epi8(chunk, cr)), _mm256_cmpeq_epi8(chunk, zero)));
+            unsigned int stop = static_cast<unsigned int>(_mm256_movemask_epi8(special));
+            if (stop) return p + countTrailingZeros(stop);
+        }
+    }
+
+    // The lookup algorithm of Keiser and Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte".
+    // Each byte is classified by the high and low nibble of the byte before it and its own high nibble,
+    // three table lookups whose intersection is the set of errors the pair makes.
+    // Blocks only tell whether they contain an error, so its position is found by the scalar validator.
+    namespace utf8 {
+        const unsigned char tooShort = 1 << 0; // 11______ 0_______, 11______ 11______
+        const unsigned char tooLong = 1 << 1; // 0_______ 10______
+        const unsigned char overlong3 = 1 << 2; // 11100000 100_____
+        const unsigned char tooLarge = 1 << 3; // 11110100 1001____, 11110100 101_____, 11110101+ 10______
+        const unsigned char surrogate = 1 << 4; // 11101101 101_____
+        const unsigned char overlong2 = 1 << 5; // 1100000_ 10______
+        const unsigned char tooLarge1000 = 1 << 6; // 11110101+ 1000____
+        const unsigned char overlong4 = 1 << 6; // 11110000 1000____
+        const unsigned char twoContinuations = 1 << 7; // 10______ 10______
+        const unsigned char carry = tooShort | tooLong | twoContinuations;
+    }
+
+    RVM_TARGET_AVX2 inline __m256i lookup16(__m256i table, __m256i index) {
+        return _mm256_shuffle_epi8(table, index);
+    }
+
+    // The bytes of input shifted right by n bytes across the two blocks, with the end of previous shifted in.
+    template<int n>
+    RVM_TARGET_AVX2 inline __m256i previousBytes(__m256i input, __m256i previous) {
+        return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(previous, input, 0x21), 16 - n);
+    }
+
+    RVM_TARGET_AVX2 __m256i utf8Errors(__m256i input, __m256i previous) {
+        using namespace utf8;
+        const __m256i lowNibble = _mm256_set1_epi8(0x0F);
+        const __m256i byte1HighTable = _mm256_setr_epi8(
+            tooLong, tooLong, tooLong, tooLong, tooLong, tooLong, tooLong, tooLong,
+            twoContinuations, twoContinuations, twoContinuations, twoContinuations,
+            tooShort | overlong2, tooShort, tooShort | overlong3 | surrogate, tooShort | tooLarge | tooLarge1000 | overlong4,
+            tooLong, tooLong, tooLong, tooLong, tooLong, tooLong, tooLong, tooLong,
+            twoContinuations, twoContinuations, twoContinuations, twoContinuations,
+            tooShort | overlong2, tooShort, tooShort | overlong3 | surrogate, tooShort | tooLarge | tooLarge1000 | overlong4);
+        const __m256i byte1LowTable = _mm256_setr_epi8(
+            carry | overlong3 | overlong2 | overlong4, carry | overlong2, carry, carry,
+            carry | tooLarge, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000,
+            carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000,
+            carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000 | surrogate, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000,
+            carry | overlong3 | overlong2 | overlong4, carry | overlong2, carry, carry,
+            carry | tooLarge, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000,
+            carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000,
+            carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000 | surrogate, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000);
+        const __m256i byte2HighTable = _mm256_setr_epi8(
+            tooShort, tooShort, tooShort, tooShort, tooShort, tooShort, tooShort, tooShort,
+            tooLong | overlong2 | twoContinuations | overlong3 | tooLarge1000 | overlong4,
+            tooLong | overlong2 | twoContinuations | overlong3 | tooLarge,
+            tooLong | overlong2 | twoContinuations | surrogate | tooLarge,
+            tooLong | overlong2 | twoContinuations | surrogate | tooLarge,
+            tooShort, tooShort, tooShort, tooShort,
+            tooShort, tooShort, tooShort, tooShort, tooShort, tooShort, tooShort, tooShort,
+            tooLong | overlong2 | twoContinuations | overlong3 | tooLarge1000 | overlong4,
+            tooLong | overlong2 | twoContinuations | overlong3 | tooLarge,
+            tooLong | overlong2 | twoContinuations | surrogate | tooLarge,
+            tooLong | overlong2 | twoContinuations | surrogate | tooLarge,
+            tooShort, tooShort, tooShort, tooShort);
+
+        __m256i previous1 = previousBytes<1>(input, previous);
+        __m256i byte1High = lookup16(byte1HighTable, _mm256_and_si256(_mm256_srli_epi16(previous1, 4), lowNibble));
+        __m256i byte1Low = lookup16(byte1LowTable, _mm256_and_si256(previous1, lowNibble));
+        __m256i byte2High = lookup16(byte2HighTable, _mm256_and_si256(_mm256_srli_epi16(input, 4), lowNibble));
+        __m256i special = _mm256_and_si256(_mm256_and_si256(byte1High, byte1Low), byte2High);
+
+        // Two bytes after a 3 or 4 byte lead and three bytes after a 4 byte lead must be continuations.
+        __m256i third = _mm256_subs_epu8(previousBytes<2>(input, previous), _mm256_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+        __m256i fourth = _mm256_subs_epu8(previousBytes<3>(input, previous), _mm256_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+        __m256i mustBeContinuation = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(static_cast<char>(0x80)));
+        return _mm256_xor_si256(mustBeContinuation, special);
+    }
+
+    // Non zero where the block ends with a lead byte whose sequence continues in the next block.
+    RVM_TARGET_AVX2 inline __m256i utf8Incomplete(__m256i input) {
+        const __m256i maxValues = _mm256_setr_epi8(
+            -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+            -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+            static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1), static_cast<char>(0xC0 - 1));
+        return _mm256_subs_epu8(input, maxValues);
+    }
+
+    RVM_TARGET_AVX2 const Char* findInvalidUtf8AVX2(const Char* begin, const Char* end) {
+        __m256i previous = _mm256_setzero_si256();
+        __m256i incomplete = _mm256_setzero_si256();
+        const Char* p = begin;
+        for (; p < end; p += 32) {
+            __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            __m256i errors;
+            if (_mm256_movemask_epi8(input) == 0) {
+                // Only a sequence left incomplete by the previous block can fail here.
+                errors = incomplete;
+                incomplete = _mm256_setzero_si256();
+            } else {
+                // Sequences continued from the previous block are checked with it as previous bytes.
+                errors = utf8Errors(input, previous);
+                incomplete = utf8Incomplete(input);
+            }
+            if (!_mm256_testz_si256(errors, errors)) break;
+            previous = input;
+        }
+        if (p >= end && _mm256_testz_si256(incomplete, incomplete)) return end;
+
+        // The error may be in a sequence that started up to 3 characters before the block.
+        for (int i = 0; i < 3 && p > begin && (static_cast<unsigned char>(p[-1]) & 0xC0) == 0x80; i++) p--;
+        if (p > begin && static_cast<unsigned char>(p[-1]) >= 0xC0) p--;
+        return findInvalidUtf8Scalar(p, end);
+    }
+
+    bool cpuSupportsAVX2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuid(info, 1);
+        bool osSavesYmm = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+        if (!osSavesYmm) return false;
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+#endif
+
+    struct Kernels {
+        const Char* (*skipWhitespace)(const Char*);
+        const Char* (*skipIdentifierTail)(const Char*);
+        const Char* (*skipStringBody)(const Char*, Char);
+        const Char* (*findInvalidUtf8)(const Char*, const Char*);
+    };
+
+    Kernels selectKernels() {
+#if RVM_SCAN_X86
+        if (cpuSupportsAVX2()) return { skipWhitespaceAVX2, skipIdentifierTailAVX2, skipStringBodyAVX2, findInvalidUtf8AVX2 };
+        return { skipWhitespaceSSE2, skipIdentifierTailSSE2, skipStringBodySSE2, findInvalidUtf8SSE2 };
+#else
+        return { skipWhitespaceScalar, skipIdentifierTailScalar, skipStringBodyScalar, findInvalidUtf8Scalar };
+#endif
+    }
+
+    const Kernels& kernels() {
+        static const Kernels selected = selectKernels();
+        return selected;
+    }
+}
+
+const Char* rvm::scan::skipWhitespace(const Char* begin) {
+    return kernels().skipWhitespace(begin);
+}
+
+const Char* rvm::scan::skipIdentifierTail(const Char* begin) {
+    return kernels().skipIdentifierTail(begin);
+}
+
+const Char* rvm::scan::skipStringBody(const Char* begin, Char terminator) {
+    return kernels().skipStringBody(begin, terminator);
+}
+
+const Char* rvm::scan::findInvalidUtf8(const Char* begin, const Char* end) {
+    return kernels().findInvalidUtf8(begin, end);
+}
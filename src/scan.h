@@ -0,0 +1,28 @@
+#ifndef RVM_SCAN_H
+#define RVM_SCAN_H
+
+#include "source.h"
+
+// Vectorized scanning kernels for the Lexer.
+// Each kernel classifies 16 (SSE2) or 32 (AVX2) characters at once and returns the first
+// character that ends the run. The implementation is picked once at runtime by CPU features,
+// with a scalar fallback for other architectures.
+// Kernels scan SourceBuffer code, they rely on its zero padding to stop and may read into it.
+namespace rvm {
+    namespace scan {
+        /// Returns the first character from begin that is not \r, \n, space or tab.
+        const Char* skipWhitespace(const Char* begin);
+
+        /// Returns the first character from begin that is not a-zA-Z0-9_, characters outside ASCII stop it too.
+        const Char* skipIdentifierTail(const Char* begin);
+
+        /// Returns the first character from begin that is terminator, \\, \r, \n or 0.
+        const Char* skipStringBody(const Char* begin, Char terminator);
+
+        /// Returns the start of the first invalid UTF-8 sequence in [begin, end), or end if there is none.
+        /// Overlong encodings, surrogates, code points above U+10FFFF and sequences truncated by end are invalid.
+        const Char* findInvalidUtf8(const Char* begin, const Char* end);
+    };
+};
+
+#endif
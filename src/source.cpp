@@ -1,27 +1,232 @@
+#include <cassert>
+#include <cerrno>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <system_error>
+#include <fstream>
+#include <sstream>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 #include "source.h"
+#include "scan.h"
 
 using namespace std;
 using namespace rvm;
 
-std::map<rvm::ErrorCode, std::string> errorCodeDescription {
+rvm::SourceBuffer::SourceBuffer(Storage storage, const Char* data, size_t size, string name) :
+    _storage(storage),
+    _data(data),
+    _size(size),
+    _mappedSize(0),
+    _name(move(name)) {
+
+    if (_size > maxSize) throw length_error(_name + ": source code larger than 4 GB.");
+    validate();
+}
+
+rvm::SourceBuffer::SourceBuffer(string code, string name) :
+    _storage(Storage::Owned),
+    _size(code.size()),
+    _owned(move(code)),
+    _mappedSize(0),
+    _name(move(name)) {
+
+    if (_size > maxSize) throw length_error(_name + ": source code larger than 4 GB.");
+    _owned.append(padding, '\0');
+    _data = _owned.data();
+    validate();
+}
+
+rvm::SourceBuffer::SourceBuffer(SourceBuffer&& other) :
+    _storage(other._storage),
+    _data(other._data),
+    _size(other._size),
+    _owned(move(other._owned)),
+    _mappedSize(other._mappedSize),
+    _name(move(other._name)),
+    _invalidUtf8(other._invalidUtf8),
+    _lineStarts(move(other._lineStarts)) {
+
+    if (_storage == Storage::Owned) _data = _owned.data();
+    other._storage = Storage::Borrowed;
+    other._mappedSize = 0;
+}
+
+// One vectorized pass, so the Lexer only decodes characters outside ASCII and never checks them.
+void rvm::SourceBuffer::validate() {
+    _invalidUtf8 = static_cast<unsigned int>(scan::findInvalidUtf8(_data, _data + _size) - _data);
+}
+
+void rvm::SourceBuffer::replace(unsigned int offset, unsigned int removed, string_view inserted) {
+    assert(_storage == Storage::Owned);
+    if (offset > _size || removed > _size - offset) throw out_of_range(_name + ": edit outside of the source code.");
+    size_t size = _size - removed + inserted.size();
+    if (size > maxSize) throw length_error(_name + ": source code larger than 4 GB.");
+
+    bool valid = isValidUtf8();
+    _owned.replace(offset, removed, inserted.data(), inserted.size());
+    _data = _owned.data();
+    _size = size;
+    _lineStarts.clear();
+    if (!valid) {
+        validate();
+        return;
+    }
+
+    // Sequences are at most 4 characters, so only those crossing the ends of the edit can turn invalid.
+    // The scan starts and ends at characters that are not continuations, which start a sequence.
+    auto isContinuation = [this](size_t position) { return (static_cast<unsigned char>(_data[position]) & 0xC0) == 0x80; };
+    size_t start = offset < 3 ? 0 : offset - 3;
+    while (start > 0 && isContinuation(start)) start--;
+    size_t end = min(offset + inserted.size() + 3, _size);
+    while (end < _size && isContinuation(end)) end++;
+    const Char* invalid = scan::findInvalidUtf8(_data + start, _data + end);
+    _invalidUtf8 = invalid == _data + end ? static_cast<unsigned int>(_size) : static_cast<unsigned int>(invalid - _data);
+}
+
+rvm::SourceBuffer::~SourceBuffer() {
+#if !defined(_WIN32)
+    if (_storage == Storage::Mapped) munmap(const_cast<Char*>(_data), _mappedSize);
+#endif
+}
+
+SourceBuffer rvm::SourceBuffer::borrow(const Char* data, size_t size, string name) {
+    for (size_t i = 0; i < padding; i++) assert(data[size + i] == 0);
+    return SourceBuffer(Storage::Borrowed, data, size, move(name));
+}
+
+#if defined(_WIN32)
+
+SourceBuffer rvm::SourceBuffer::fromFile(const string& path) {
+    ifstream file(path, ios::binary);
+    if (!file) throw system_error(errno, generic_category(), path);
+    stringstream code;
+    code << file.rdbuf();
+    return SourceBuffer(code.str(), path);
+}
+
+#else
+
+SourceBuffer rvm::SourceBuffer::fromFile(const string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw system_error(errno, generic_category(), path);
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        int error = errno;
+        close(fd);
+        throw system_error(error, generic_category(), path);
+    }
+
+    // Reserve zero pages for the file and the padding, then map the file over the start.
+    // The tail of the last file page is zero filled by the kernel, the rest is anonymous memory.
+    size_t size = static_cast<size_t>(info.st_size);
+    if (size > maxSize) {
+        close(fd);
+        throw length_error(path + ": source code larger than 4 GB.");
+    }
+    size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t mappedSize = (size + padding + pageSize - 1) / pageSize * pageSize;
+
+    void* reserved = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (reserved == MAP_FAILED) {
+        int error = errno;
+        close(fd);
+        throw system_error(error, generic_category(), path);
+    }
+
+    if (size > 0 && mmap(reserved, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        int error = errno;
+        munmap(reserved, mappedSize);
+        close(fd);
+        throw system_error(error, generic_category(), path);
+    }
+    close(fd);
+
+    SourceBuffer buffer(Storage::Mapped, static_cast<const Char*>(reserved), size, path);
+    buffer._mappedSize = mappedSize;
+    return buffer;
+}
+
+#endif
+
+const std::map<rvm::ErrorCode, std::string> errorCodeDescription {
     // Lexer errors
     { UnexpectedEoF, "Lexer error, unexpected end of file."s },
     { UnexpectedCharacter, "Lexed error, unexpected character."s },
     { ExpectedADigit, "Lexed error, expected a digit from 0 to 9."s },
     { NumberOverflow, "Lexed error, number too large."s },
+    { InvalidEscapeSequence, "Lexed error, invalid escape sequence."s },
+    { InvalidUtf8, "Lexed error, invalid UTF-8."s },
 
     { UnknownSymbolReference, "Binder error, unknown symbol reference."},
 
     // Parser errors
-    { UnexpectedEoF, "Parser error, unexpected end of file."s },
+    { UnexpectedParserEoF, "Parser error, unexpected end of file."s },
     { UnexpectedToken, "Parser error, unexpected token."s },
     { ExpectedIdentifier, "Parser error, expected an identifier."s },
+    { ExpressionTooDeep, "Parser error, expression nested too deep."s },
+
+    // Type errors
+    { NoMatchingOverload, "Type error, no overload matches the argument types."s },
 };
 
+SourcePoint rvm::SourceBuffer::resolve(SourceLocation location) const {
+    if (_lineStarts.empty()) {
+        _lineStarts.push_back(0);
+        const Char* end = this->end();
+        for (const Char* c = _data; (c = static_cast<const Char*>(memchr(c, '\n', end - c))) != nullptr; ) {
+            _lineStarts.push_back(static_cast<unsigned int>(++c - _data));
+        }
+    }
+
+    auto line = upper_bound(_lineStarts.begin(), _lineStarts.end(), location.offset) - 1;
+    return SourcePoint(static_cast<unsigned int>(line - _lineStarts.begin()) + 1, location.offset - *line + 1);
+}
+
+string rvm::SourceBuffer::toString(SourceSpan span) const {
+    SourcePoint start = resolve(span.start);
+    SourcePoint end = resolve(span.end);
+    return start == end ? start.toString() : start.toString() + "-"s + end.toString();
+}
+
 rvm::CompilerError::CompilerError(ErrorCode code, SourceSpan span) :
     _code(code),
-    _span(span),
-    _message(errorCodeDescription[code] + " ("s + span.toString() + ")") {
+    _span(span) {
+}
+
+rvm::CompilerError::CompilerError(ErrorCode code, SourceLocation location) : CompilerError(code, {location, location}) {}
+
+const char* rvm::CompilerError::what() const throw() {
+    auto description = errorCodeDescription.find(_code);
+    return description == errorCodeDescription.end() ? "Compiler error." : description->second.c_str();
+}
+
+string rvm::CompilerError::format(const SourceBuffer& source) const {
+    string location = source.toString(_span);
+    if (!source.name().empty()) location = source.name() + ":"s + location;
+    return what() + " ("s + location + ")";
+}
+
+ostream& operator<< (ostream& out, const SourcePoint& point) {
+    return out << point.line << ":" << point.column;
 }
 
-rvm::CompilerError::CompilerError(ErrorCode code, SourcePoint point) : CompilerError(code, {point, point}) {}
+ostream& operator<< (ostream& out, const SourceLocation& location) {
+    return out << "@" << location.offset;
+}
+
+ostream& operator<< (ostream& out, const SourceSpan& span) {
+    if (span.start == span.end) {
+        return out << span.start;
+    } else {
+        return out << span.start << "-" << span.end.offset;
+    }
+}
@@ -2,17 +2,40 @@
 #define RVM_SOURCE_H
 
 #include <string>
+#include <string_view>
+#include <vector>
 #include <map>
 #include <exception>
 #include <iostream>
 
 namespace rvm {
-    typedef typename std::string::iterator StringIterator;
     typedef typename std::string::value_type Char;
 
+    /// A compact position in a SourceBuffer, the offset of a character from the start of the code.
+    /// Line and column are only resolved, with SourceBuffer::resolve, when they are printed.
+    struct SourceLocation {
+        unsigned int offset;
+        SourceLocation() : offset(0) {}
+        explicit SourceLocation(unsigned int offset) : offset(offset) {}
+
+        bool operator==(const SourceLocation& other) const { return offset == other.offset; }
+        bool operator!=(const SourceLocation& other) const { return offset != other.offset; }
+    };
+
+    struct SourceSpan {
+        SourceLocation start;
+        SourceLocation end;
+
+        bool operator==(const SourceSpan& other) const {
+            return start == other.start && end == other.end;
+        }
+    };
+
+    /// A resolved line and column, both starting from 1.
     struct SourcePoint {
         unsigned int line, column;
         SourcePoint() : line(1), column(1) {}
+        SourcePoint(unsigned int line, unsigned int column) : line(line), column(column) {}
 
         std::string toString() const {
             return std::to_string(line) + std::string(":") + std::to_string(column);
@@ -23,24 +46,73 @@ namespace rvm {
         }
     };
 
-    struct SourceSpan {
-        SourcePoint start;
-        SourcePoint end;
+    /// Read-only source code of a module, only code it owns can be edited in place.
+    /// The code is always followed by at least SourceBuffer::padding zero characters,
+    /// so the Lexer can look ahead and run vectorized scans without checking for the end.
+    class SourceBuffer {
+    public:
+        static const size_t padding = 64;
 
-        std::string toString() const {
-            return start == end ? start.toString() : start.toString() + std::string("-") + end.toString();
-        }
+        /// SourceLocations are 32 bit offsets, so that is the size limit of a module.
+        static const size_t maxSize = 0xFFFFFFFFU;
 
-        bool operator==(const SourceSpan& other) const {
-            return start == other.start && end == other.end;
-        }
-    };
+    private:
+        enum class Storage { Owned, Mapped, Borrowed };
 
-    struct StringSpan {
-        StringIterator start;
-        StringIterator end;
+        Storage _storage;
+        const Char* _data;
+        size_t _size;
+        std::string _owned;
+        size_t _mappedSize;
+        std::string _name;
+        unsigned int _invalidUtf8;
 
-        std::string toString() const { return std::string(start, end); }
+        // Offsets of the first character of each line, built on the first resolve.
+        mutable std::vector<unsigned int> _lineStarts;
+
+        SourceBuffer(Storage storage, const Char* data, size_t size, std::string name);
+        void validate();
+
+    public:
+        /// Takes ownership of code, the padding is appended in place.
+        SourceBuffer(std::string code, std::string name = std::string());
+        SourceBuffer(SourceBuffer&& other);
+        SourceBuffer(const SourceBuffer&) = delete;
+        SourceBuffer& operator=(const SourceBuffer&) = delete;
+        ~SourceBuffer();
+
+        /// Maps the file at path read-only, the padding is mapped as zero pages after the file.
+        /// Throws std::system_error if the file can not be read.
+        static SourceBuffer fromFile(const std::string& path);
+
+        /// Uses caller owned memory without copying, data must stay valid while the SourceBuffer is in use.
+        /// The caller guarantees data[size] to data[size + padding - 1] are readable zero characters.
+        static SourceBuffer borrow(const Char* data, size_t size, std::string name = std::string());
+
+        /// Replaces removed characters at offset with inserted, in code the SourceBuffer owns.
+        /// Views of the code after offset are invalid after it, and all of them when it grows past its capacity.
+        /// Only the characters around the edit are validated again. Throws std::out_of_range if the
+        /// removed characters are not all in the code, or std::length_error if it grows past maxSize.
+        void replace(unsigned int offset, unsigned int removed, std::string_view inserted);
+
+        const Char* begin() const { return _data; }
+        const Char* end() const { return _data + _size; }
+        size_t size() const { return _size; }
+        std::string_view code() const { return std::string_view(_data, _size); }
+        std::string_view code(SourceSpan span) const { return std::string_view(_data + span.start.offset, span.end.offset - span.start.offset); }
+        const std::string& name() const { return _name; }
+
+        /// The code is validated as UTF-8 when the SourceBuffer is created, this is the location of
+        /// the first invalid sequence, or the end of the code when it is all valid.
+        SourceLocation invalidUtf8() const { return SourceLocation(_invalidUtf8); }
+        bool isValidUtf8() const { return _invalidUtf8 == _size; }
+
+        SourceLocation location(const Char* position) const { return SourceLocation(static_cast<unsigned int>(position - _data)); }
+
+        /// Resolves the line and column of location, by a binary search over the line starts.
+        /// The first call builds the line start table, so it is not safe to call concurrently.
+        SourcePoint resolve(SourceLocation location) const;
+        std::string toString(SourceSpan span) const;
     };
 
     enum ErrorCode {
@@ -49,11 +121,14 @@ namespace rvm {
         UnexpectedCharacter = 1002,
         ExpectedADigit = 1003,
         NumberOverflow = 1004,
+        InvalidEscapeSequence = 1005,
+        InvalidUtf8 = 1006,
 
         // Parser errors
         UnexpectedParserEoF = 2001,
         UnexpectedToken = 2002,
         ExpectedIdentifier = 2003,
+        ExpressionTooDeep = 2004,
 
         // Symbol errors
         UnknownSymbolReference = 3001,
@@ -63,24 +138,30 @@ namespace rvm {
         UnaryExpressionTypeError = 4002,
         BinaryExpressionTypeError = 4003,
         NotCallable = 4004,
+        NoMatchingOverload = 4005,
     };
 
     class CompilerError : public std::exception {
         ErrorCode _code;
         SourceSpan _span;
 
-        std::string _message;
-
     public:
         CompilerError(ErrorCode code, SourceSpan span);
-        CompilerError(ErrorCode code, SourcePoint point);
+        CompilerError(ErrorCode code, SourceLocation location);
+
+        ErrorCode code() const { return _code; }
+        SourceSpan span() const { return _span; }
+
+        /// The error description, without the location.
+        virtual const char* what() const throw();
 
-        SourceSpan span() { return _span; }
-        virtual const char* what() const throw() { return _message.c_str(); }
+        /// The error description followed by the resolved location in source.
+        std::string format(const SourceBuffer& source) const;
     };
 };
 
 std::ostream& operator<< (std::ostream& out, const rvm::SourcePoint& point);
+std::ostream& operator<< (std::ostream& out, const rvm::SourceLocation& location);
 std::ostream& operator<< (std::ostream& out, const rvm::SourceSpan& span);
 
-#endif
\ No newline at end of file
+#endif
@@ -1,20 +1,32 @@
 #ifndef RVM_SYMBOL_H
 #define RVM_SYMBOL_H
 
-#include <string>
+#include <vector>
+#include <algorithm>
+#include "atom.h"
 #include "types.h"
+#include "overloads.h"
 #include "ast.h"
 
 namespace rvm {
     /// Symbols can be looked up in NameScopes by name,
     /// and represent a list of resolved declarations.
     class Symbol : public rvm::type::Type {
-        std::string _name;
-        std::vector<rvm::ast::ModuleMember*> _declarations;
+        Atom _name;
+        std::vector<rvm::ast::NodeId> _declarations;
+        rvm::type::OverloadSet _callSignatures;
 
     public:
-        Symbol(std::string name) : _declarations(), _name(name) {}
-        void add(rvm::ast::ModuleMember* declaration) { _declarations.push_back(declaration); }
+        Symbol(Atom name) : _name(name), _declarations() {}
+        Atom name() const { return _name; }
+        void add(rvm::ast::NodeId declaration) { _declarations.push_back(declaration); }
+        void remove(rvm::ast::NodeId declaration) { _declarations.erase(std::remove(_declarations.begin(), _declarations.end(), declaration), _declarations.end()); }
+        const std::vector<rvm::ast::NodeId>& declarations() const { return _declarations; }
+
+        /// The signatures of the declarations, added by the TypeChecker before it checks any call.
+        void addCallSignature(rvm::type::SignatureType* signature) { _callSignatures.add(signature); }
+        void clearCallSignatures() { _callSignatures.clear(); }
+        const rvm::type::OverloadSet& callSignatures() const override { return _callSignatures; }
     };
 
     class Reference : public rvm::type::Type {
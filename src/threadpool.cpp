@@ -0,0 +1,91 @@
+#include <atomic>
+#include <memory>
+#include <exception>
+
+#include "threadpool.h"
+
+using namespace std;
+using namespace rvm;
+
+rvm::ThreadPool::ThreadPool(unsigned int threads) : _stopping(false) {
+    if (threads == 0) threads = thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    _workers.reserve(threads);
+    for (unsigned int i = 0; i < threads; i++) _workers.emplace_back([this] { work(); });
+}
+
+rvm::ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _available.notify_all();
+    for (auto& worker : _workers) worker.join();
+}
+
+ThreadPool& rvm::ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void rvm::ThreadPool::work() {
+    while (true) {
+        function<void()> task;
+        {
+            unique_lock<mutex> lock(_mutex);
+            _available.wait(lock, [this] { return _stopping || !_tasks.empty(); });
+            if (_tasks.empty()) return;
+            task = move(_tasks.front());
+            _tasks.pop();
+        }
+        task();
+    }
+}
+
+void rvm::ThreadPool::submit(function<void()> task) {
+    {
+        lock_guard<mutex> lock(_mutex);
+        _tasks.push(move(task));
+    }
+    _available.notify_one();
+}
+
+void rvm::ThreadPool::parallelFor(size_t count, const function<void(size_t)>& body) {
+    if (count == 0) return;
+
+    // Every participant pulls indices from a shared counter, so uneven items balance out.
+    // The caller only waits for claimed indices, helpers that start late find nothing left and
+    // return, so a parallelFor running inside a task can not wait on a queue it is blocking.
+    struct State {
+        atomic<size_t> next { 0 };
+        size_t completed = 0;
+        mutex guard;
+        condition_variable finished;
+        exception_ptr error;
+    };
+    auto state = make_shared<State>();
+    const function<void(size_t)>* work = &body;
+
+    auto run = [state, work, count] {
+        for (size_t i; (i = state->next.fetch_add(1)) < count; ) {
+            exception_ptr error;
+            try {
+                (*work)(i);
+            } catch (...) {
+                error = current_exception();
+            }
+            lock_guard<mutex> lock(state->guard);
+            if (error && !state->error) state->error = error;
+            if (++state->completed == count) state->finished.notify_all();
+        }
+    };
+
+    size_t helpers = count - 1 < _workers.size() ? count - 1 : _workers.size();
+    for (size_t i = 0; i < helpers; i++) submit(run);
+
+    run();
+
+    unique_lock<mutex> lock(state->guard);
+    state->finished.wait(lock, [&state, count] { return state->completed == count; });
+    if (state->error) rethrow_exception(state->error);
+}
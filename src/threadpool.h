@@ -0,0 +1,44 @@
+#ifndef RVM_THREADPOOL_H
+#define RVM_THREADPOOL_H
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace rvm {
+    /// A fixed set of worker threads running submitted tasks in order.
+    class ThreadPool {
+        std::vector<std::thread> _workers;
+        std::queue<std::function<void()> > _tasks;
+        std::mutex _mutex;
+        std::condition_variable _available;
+        bool _stopping;
+
+        void work();
+
+    public:
+        /// Starts threads workers, 0 means one per hardware thread.
+        ThreadPool(unsigned int threads = 0);
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /// Finishes the queued tasks and joins the workers.
+        ~ThreadPool();
+
+        /// The pool shared by the compiler passes, sized to the hardware.
+        static ThreadPool& shared();
+
+        size_t size() const { return _workers.size(); }
+
+        void submit(std::function<void()> task);
+
+        /// Calls body(i) for i in [0, count) on the workers and the calling thread, and waits for all of them.
+        /// The first exception thrown by body is rethrown once every call has finished.
+        void parallelFor(size_t count, const std::function<void(size_t)>& body);
+    };
+};
+
+#endif
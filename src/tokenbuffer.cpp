@@ -0,0 +1,251 @@
+#include <cstring>
+#include <cstdint>
+
+#include "tokenbuffer.h"
+#include "threadpool.h"
+
+using namespace std;
+using namespace rvm;
+
+rvm::TokenBuffer::TokenBuffer(const SourceBuffer& source, DiagnosticEngine* diagnostics) : TokenBuffer() {
+    // Roughly one token every 4 characters in typical code, whitespace excluded.
+    size_t estimate = source.size() / 4 + 1;
+    _kinds.reserve(estimate);
+    _offsets.reserve(estimate);
+    _lengths.reserve(estimate);
+    _valueIndices.reserve(estimate);
+
+    lex(source, 0, static_cast<unsigned int>(source.size()), diagnostics);
+    finish(source);
+}
+
+rvm::TokenBuffer::TokenBuffer(const SourceBuffer& source, ThreadPool& pool, DiagnosticEngine* diagnostics, size_t chunkSize) : TokenBuffer() {
+    unsigned int size = static_cast<unsigned int>(source.size());
+    if (size <= chunkSize || pool.size() < 2) {
+        lex(source, 0, size, diagnostics);
+        finish(source);
+        return;
+    }
+
+    vector<unsigned int> boundaries { 0 };
+    for (size_t target = chunkSize; target < size; target += chunkSize) {
+        if (target <= boundaries.back()) continue;
+        const void* newline = memchr(source.begin() + target, '\n', size - target);
+        if (newline == nullptr) break;
+        unsigned int boundary = static_cast<unsigned int>(static_cast<const Char*>(newline) - source.begin()) + 1;
+        if (boundary < size) boundaries.push_back(boundary);
+    }
+    boundaries.push_back(size);
+
+    size_t count = boundaries.size() - 1;
+    vector<TokenBuffer> chunks;
+    chunks.reserve(count);
+    for (size_t i = 0; i < count; i++) chunks.push_back(TokenBuffer());
+    vector<DiagnosticEngine> chunkDiagnostics(diagnostics ? count : 0);
+    pool.parallelFor(count, [&](size_t i) {
+        chunks[i].lex(source, boundaries[i], boundaries[i + 1], diagnostics ? &chunkDiagnostics[i] : nullptr);
+    });
+    // A chunk lexes the first token of the next one to see where it ends, its errors belong to the next chunk.
+    for (size_t i = 0; i < chunkDiagnostics.size(); i++) {
+        for (auto& diagnostic : chunkDiagnostics[i].diagnostics()) {
+            if (i + 1 == count || diagnostic.span.start.offset < boundaries[i + 1]) diagnostics->report(diagnostic.code, diagnostic.span);
+        }
+    }
+
+    // Serial lexing stops at the first error, so chunks after a failed one are dropped.
+    size_t used = 0;
+    while (used < count && !chunks[used++].failed()) {}
+    if (chunks[used - 1].failed()) _error = chunks[used - 1]._error;
+
+    // Offsets are already relative to the source, only indices into the value arrays move.
+    struct Base { size_t tokens, integers, floats, strings; };
+    vector<Base> bases(used + 1, Base { 0, 0, 0, 0 });
+    for (size_t i = 0; i < used; i++) {
+        bases[i + 1].tokens = bases[i].tokens + chunks[i]._kinds.size();
+        bases[i + 1].integers = bases[i].integers + chunks[i]._integers.size();
+        bases[i + 1].floats = bases[i].floats + chunks[i]._floats.size();
+        bases[i + 1].strings = bases[i].strings + chunks[i]._strings.size();
+    }
+
+    const Base& total = bases[used];
+    _kinds.resize(total.tokens);
+    _offsets.resize(total.tokens);
+    _lengths.resize(total.tokens);
+    _valueIndices.resize(total.tokens);
+    _integers.resize(total.integers);
+    _floats.resize(total.floats);
+    _strings.resize(total.strings);
+    for (size_t i = 0; i < used; i++) {
+        _decodedStrings.take(chunks[i]._decodedStrings);
+        _reported = _reported || chunks[i]._reported;
+    }
+
+    pool.parallelFor(used, [&](size_t i) {
+        const TokenBuffer& chunk = chunks[i];
+        const Base& base = bases[i];
+        copy(chunk._kinds.begin(), chunk._kinds.end(), _kinds.begin() + base.tokens);
+        copy(chunk._offsets.begin(), chunk._offsets.end(), _offsets.begin() + base.tokens);
+        copy(chunk._lengths.begin(), chunk._lengths.end(), _lengths.begin() + base.tokens);
+        copy(chunk._integers.begin(), chunk._integers.end(), _integers.begin() + base.integers);
+        copy(chunk._floats.begin(), chunk._floats.end(), _floats.begin() + base.floats);
+        copy(chunk._strings.begin(), chunk._strings.end(), _strings.begin() + base.strings);
+
+        for (size_t token = 0; token < chunk._kinds.size(); token++) {
+            unsigned int valueIndex = chunk._valueIndices[token];
+            switch (chunk._kinds[token]) {
+                case TokenType::Integer: valueIndex += static_cast<unsigned int>(base.integers); break;
+                case TokenType::Float: valueIndex += static_cast<unsigned int>(base.floats); break;
+                case TokenType::SingleQuotesString:
+                case TokenType::DoubleQuotesString: valueIndex += static_cast<unsigned int>(base.strings); break;
+                default: break;
+            }
+            _valueIndices[base.tokens + token] = valueIndex;
+        }
+    });
+
+    finish(source);
+}
+
+// Appends the tokens that start in [from, to), stopping at the first error.
+void rvm::TokenBuffer::lex(const SourceBuffer& source, unsigned int from, unsigned int to, DiagnosticEngine* diagnostics) {
+    Lexer lexer(source, diagnostics);
+    try {
+        for (auto token = lexer.at(SourceLocation(from)); token->type() != TokenType::EoF && token->location().offset < to; ++token) {
+            if (token->type() != TokenType::Whitespace) push(*token);
+        }
+    } catch (const CompilerError& e) {
+        _error = e;
+    }
+    _decodedStrings.take(lexer.strings());
+}
+
+// Ends the buffer with EoF, at the error if lexing failed.
+void rvm::TokenBuffer::finish(const SourceBuffer& source) {
+    _kinds.push_back(TokenType::EoF);
+    _offsets.push_back(_error ? _error->span().start.offset : static_cast<unsigned int>(source.size()));
+    _lengths.push_back(0);
+    _valueIndices.push_back(0);
+    bind();
+}
+
+void rvm::TokenBuffer::bind() {
+    _kindData = _kinds.data();
+    _offsetData = _offsets.data();
+    _lengthData = _lengths.data();
+    _valueIndexData = _valueIndices.data();
+    _integerData = _integers.data();
+    _floatData = _floats.data();
+    _size = _kinds.size();
+}
+
+bool rvm::TokenBuffer::splice(const Char* previous, const SourceBuffer& source, size_t first, size_t last,
+    unsigned int from, unsigned int to, unsigned int edited, long long delta) {
+    TokenBuffer window;
+    Lexer lexer(source);
+    try {
+        for (auto token = lexer.at(SourceLocation(from)); token->type() != TokenType::EoF && token->location().offset < to; ++token) {
+            // A comment or string opened by the edit, the tokens after the window would lex differently.
+            if (token->span().end.offset > to) return false;
+            if (token->type() != TokenType::Whitespace) window.push(*token);
+        }
+    } catch (const CompilerError&) {
+        return false;
+    }
+    _decodedStrings.take(lexer.strings());
+
+    // The strings of the replaced tokens are dropped, the others view the same code in the edited source.
+    for (size_t token = first; token < last; token++) {
+        if (_kinds[token] == TokenType::SingleQuotesString || _kinds[token] == TokenType::DoubleQuotesString) _strings[_valueIndices[token]] = string_view();
+    }
+    // The code may have moved, so views are found by address and not read.
+    if (previous != source.begin() || delta != 0) {
+        uintptr_t begin = reinterpret_cast<uintptr_t>(previous), end = begin + source.size() - delta;
+        for (auto& text : _strings) {
+            uintptr_t address = reinterpret_cast<uintptr_t>(text.data());
+            if (address < begin || address > end) continue;
+            size_t position = address - begin;
+            if (position >= edited) position += delta;
+            text = string_view(source.begin() + position, text.size());
+        }
+    }
+
+    // Values of the window go after the existing ones, those of the replaced tokens stay unused.
+    for (size_t token = 0; token < window._kinds.size(); token++) {
+        switch (window._kinds[token]) {
+            case TokenType::Integer: window._valueIndices[token] += static_cast<unsigned int>(_integers.size()); break;
+            case TokenType::Float: window._valueIndices[token] += static_cast<unsigned int>(_floats.size()); break;
+            case TokenType::SingleQuotesString:
+            case TokenType::DoubleQuotesString: window._valueIndices[token] += static_cast<unsigned int>(_strings.size()); break;
+            default: break;
+        }
+    }
+    _integers.insert(_integers.end(), window._integers.begin(), window._integers.end());
+    _floats.insert(_floats.end(), window._floats.begin(), window._floats.end());
+    _strings.insert(_strings.end(), window._strings.begin(), window._strings.end());
+
+    auto replace = [first, last](auto& tokens, const auto& replacement) {
+        size_t count = min(last - first, replacement.size());
+        copy(replacement.begin(), replacement.begin() + count, tokens.begin() + first);
+        if (count < replacement.size()) tokens.insert(tokens.begin() + last, replacement.begin() + count, replacement.end());
+        else tokens.erase(tokens.begin() + first + count, tokens.begin() + last);
+    };
+    replace(_kinds, window._kinds);
+    replace(_offsets, window._offsets);
+    replace(_lengths, window._lengths);
+    replace(_valueIndices, window._valueIndices);
+    if (delta != 0) {
+        for (size_t token = first + window._kinds.size(); token < _offsets.size(); token++) _offsets[token] = static_cast<unsigned int>(_offsets[token] + delta);
+    }
+    bind();
+    return true;
+}
+
+void rvm::TokenBuffer::push(const Lexer::Token& token) {
+    _kinds.push_back(token._type);
+    _offsets.push_back(token._location.offset);
+    _lengths.push_back(token._length);
+
+    unsigned int valueIndex = 0;
+    switch (token._type) {
+        case TokenType::Identifier:
+            valueIndex = get<Atom>(token._value).id();
+            break;
+        case TokenType::Integer:
+            valueIndex = static_cast<unsigned int>(_integers.size());
+            _integers.push_back(get<unsigned long long>(token._value));
+            break;
+        case TokenType::Float:
+            valueIndex = static_cast<unsigned int>(_floats.size());
+            _floats.push_back(get<double>(token._value));
+            break;
+        case TokenType::SingleQuotesString:
+        case TokenType::DoubleQuotesString:
+            valueIndex = static_cast<unsigned int>(_strings.size());
+            _strings.push_back(get<string_view>(token._value));
+            break;
+        case TokenType::Error:
+            _reported = true;
+            break;
+        default:
+            break;
+    }
+    _valueIndices.push_back(valueIndex);
+}
+
+Lexer::Token rvm::TokenBuffer::token(size_t index) const {
+    Lexer::Token token;
+    token._type = _kindData[index];
+    token._location = SourceLocation(_offsetData[index]);
+    token._length = _lengthData[index];
+
+    unsigned int valueIndex = _valueIndexData[index];
+    switch (token._type) {
+        case TokenType::Identifier: token._value = Atom(_atoms.empty() ? valueIndex : _atoms[valueIndex]); break;
+        case TokenType::Integer: token._value = _integerData[valueIndex]; break;
+        case TokenType::Float: token._value = _floatData[valueIndex]; break;
+        case TokenType::SingleQuotesString:
+        case TokenType::DoubleQuotesString: token._value = _strings[valueIndex]; break;
+        default: break;
+    }
+    return token;
+}
@@ -0,0 +1,97 @@
+#ifndef RVM_TOKENBUFFER_H
+#define RVM_TOKENBUFFER_H
+
+#include <vector>
+#include <optional>
+#include "lexer.h"
+
+namespace rvm {
+    class ThreadPool;
+    class ASTCache;
+    class Parser;
+
+    /// All tokens of a SourceBuffer, lexed in one pass and stored as parallel arrays.
+    /// Whitespace is dropped and the last token is always TokenType::EoF,
+    /// so the Parser can walk tokens by index and look ahead any distance.
+    /// With a DiagnosticEngine lexer errors are reported there and kept as TokenType::Error tokens.
+    ///
+    /// Token values are stored by kind, the value index of a token points into the array for its kind:
+    /// integers, floats or strings, and for identifiers it is the Atom id.
+    /// Strings view the source, or the TokenBuffer's own copy for literals with escape sequences.
+    ///
+    /// A TokenBuffer loaded by the ASTCache views the arrays in the mapped cache file instead,
+    /// its identifiers are numbered per file and mapped to Atoms when it is loaded.
+    class TokenBuffer {
+        std::vector<TokenType> _kinds;
+        std::vector<unsigned int> _offsets;
+        std::vector<unsigned int> _lengths;
+        std::vector<unsigned int> _valueIndices;
+
+        std::vector<unsigned long long> _integers;
+        std::vector<double> _floats;
+        std::vector<std::string_view> _strings;
+        Arena _decodedStrings;
+
+        std::optional<CompilerError> _error;
+        // Set by the first Error token, the lexer reported an error to the DiagnosticEngine.
+        bool _reported;
+
+        // The arrays are read through these, they point into the vectors above or into a mapped file.
+        const TokenType* _kindData;
+        const unsigned int* _offsetData;
+        const unsigned int* _lengthData;
+        const unsigned int* _valueIndexData;
+        const unsigned long long* _integerData;
+        const double* _floatData;
+        size_t _size;
+
+        // The Atom ids of the file's identifier numbers, empty when the value indices are Atom ids.
+        std::vector<unsigned int> _atoms;
+
+        friend class rvm::ASTCache;
+        friend class rvm::Parser;
+
+        TokenBuffer() : _reported(false), _kindData(nullptr), _offsetData(nullptr), _lengthData(nullptr), _valueIndexData(nullptr),
+            _integerData(nullptr), _floatData(nullptr), _size(0) {}
+        void lex(const SourceBuffer& source, unsigned int from, unsigned int to, DiagnosticEngine* diagnostics);
+        void finish(const SourceBuffer& source);
+        void push(const Lexer::Token& token);
+        void bind();
+
+        // After an edit moved the code from edited on by delta, replaces the tokens [first, last) with those of source in [from, to)
+        // and moves the tokens after them. previous is where the code started before the edit, strings viewing it are moved to source.
+        // Returns false and changes nothing when the window has a lexer error or a token runs past to.
+        bool splice(const Char* previous, const SourceBuffer& source, size_t first, size_t last,
+            unsigned int from, unsigned int to, unsigned int edited, long long delta);
+
+    public:
+        /// Sources are split for parallel lexing in chunks of about this many characters.
+        static const size_t defaultChunkSize = 256 * 1024;
+
+        /// Lexes all of source, the SourceBuffer must outlive the TokenBuffer.
+        /// A lexer error does not throw here, the tokens before it are kept followed by EoF
+        /// and throwIfFailed rethrows the error once the consumer reaches the end.
+        TokenBuffer(const SourceBuffer& source, DiagnosticEngine* diagnostics = nullptr);
+
+        /// Lexes source in chunks on pool, with the same tokens and error as lexing it serially.
+        /// Chunks end after a newline, which is always a token boundary since tokens other than
+        /// whitespace never contain one. Sources smaller than a chunk are lexed on the calling thread.
+        TokenBuffer(const SourceBuffer& source, ThreadPool& pool, DiagnosticEngine* diagnostics = nullptr, size_t chunkSize = defaultChunkSize);
+
+        /// The number of tokens, including the final EoF.
+        size_t size() const { return _size; }
+
+        /// The kind of the token at index, indices past the end are EoF.
+        TokenType kind(size_t index) const { return index < _size ? _kindData[index] : TokenType::EoF; }
+        SourceLocation location(size_t index) const { return SourceLocation(_offsetData[index]); }
+        SourceSpan span(size_t index) const { return { SourceLocation(_offsetData[index]), SourceLocation(_offsetData[index] + _lengthData[index]) }; }
+
+        /// Builds the Token at index, for AST nodes that keep their tokens.
+        Lexer::Token token(size_t index) const;
+
+        bool failed() const { return _error.has_value(); }
+        void throwIfFailed() const { if (_error) throw *_error; }
+    };
+};
+
+#endif
@@ -1 +1,110 @@
-#include "typechecker.h"
\ No newline at end of file
+#include <algorithm>
+#include <optional>
+
+#include "typechecker.h"
+#include "threadpool.h"
+#include "query.h"
+
+using namespace std;
+using namespace rvm;
+using namespace rvm::ast;
+
+void rvm::TypeChecker::check(Parser* module) {
+    Tree* outer = _tree;
+    _tree = &module->tree();
+    for (auto member : module->members()) declare(member);
+    _tree = outer;
+    _calls.clear();
+
+    if (_pool != nullptr && checkMembersInParallel(module)) return;
+    module->visit(this);
+}
+
+// The members are checked in chunks on the pool, each chunk by a TypeChecker of its own, and the diagnostics of the chunks
+// are reported in member order once all are done. Bodies only read the Symbols, the signatures interned before and the
+// types of their own nodes, so the chunks share nothing but the TypeContext, which locks.
+// Without a DiagnosticEngine the error of the first member that threw is thrown, the one a serial check would throw first.
+bool rvm::TypeChecker::checkMembersInParallel(Parser* module) {
+    auto& members = module->members();
+    if (_pool->size() < 2 || members.size() < 2) return false;
+
+    // Deferred bodies are parsed here, a Tree only grows on the thread that owns it. Their errors are kept apart
+    // to be reported with the type errors of their member, a body that throws is checked after the members before it.
+    Tree& tree = module->tree();
+    size_t count = members.size();
+    DiagnosticEngine parsed;
+    vector<size_t> parsedEnds(count);
+    optional<CompilerError> parseError;
+    DiagnosticEngine* syntax = module->setDiagnostics(&parsed);
+    for (size_t i = 0; i < count; i++) {
+        try {
+            if (tree.kind(members[i]) == Kind::Function) tree.codeBlock(members[i]);
+        } catch (CompilerError& error) {
+            parseError = error;
+            count = i;
+            break;
+        }
+        parsedEnds[i] = parsed.size();
+    }
+    module->setDiagnostics(syntax);
+    tree.allocateTypes();
+
+    size_t chunks = min(count, _pool->size() * 4);
+    vector<DiagnosticEngine> diagnostics(chunks);
+    vector<size_t> checkedEnds(count);
+    vector<optional<CompilerError> > errors(chunks);
+    vector<size_t> thrown(chunks);
+    _pool->parallelFor(chunks, [&](size_t chunk) {
+        TypeChecker checker(*this, _diagnostics != nullptr ? &diagnostics[chunk] : nullptr);
+        for (size_t i = chunk * count / chunks, end = (chunk + 1) * count / chunks; i < end; i++) {
+            try {
+                checker.visit(tree, members[i]);
+            } catch (CompilerError& error) {
+                errors[chunk] = error;
+                thrown[chunk] = i;
+                break;
+            }
+            checkedEnds[i] = diagnostics[chunk].size();
+        }
+    });
+
+    // A serial check reports the syntax errors of a body before its type errors.
+    auto& syntaxErrors = parsed.diagnostics();
+    for (size_t chunk = 0, i = 0, reported = 0; chunk < chunks; chunk++) {
+        auto& typeErrors = diagnostics[chunk].diagnostics();
+        for (size_t checked = 0, end = (chunk + 1) * count / chunks; i < end; i++) {
+            for (; reported < parsedEnds[i]; reported++) syntax->report(syntaxErrors[reported].code, syntaxErrors[reported].span);
+            if (errors[chunk] && thrown[chunk] == i) throw *errors[chunk];
+            for (; checked < checkedEnds[i]; checked++) _diagnostics->report(typeErrors[checked].code, typeErrors[checked].span);
+        }
+    }
+    if (parseError) {
+        for (size_t reported = count > 0 ? parsedEnds[count - 1] : 0; reported < syntaxErrors.size(); reported++) {
+            syntax->report(syntaxErrors[reported].code, syntaxErrors[reported].span);
+        }
+        throw *parseError;
+    }
+    return true;
+}
+
+void rvm::TypeChecker::require(Atom name) {
+    _queries->callSignatures(name);
+}
+
+rvm::type::SignatureType* rvm::TypeChecker::signature(Tree& tree, NodeId member) {
+    Tree* outer = _tree;
+    _tree = &tree;
+    NodeId proto = tree.proto(member);
+    onFunctionPrototype(proto);
+    _tree = outer;
+    return static_cast<rvm::type::SignatureType*>(tree.type(proto));
+}
+
+void rvm::TypeChecker::body(Tree& tree, NodeId function) {
+    Tree* outer = _tree;
+    _tree = &tree;
+    // A deferred body with errors is noNode, they were reported when parsing it.
+    NodeId block = tree.codeBlock(function);
+    if (block != noNode) visit(block);
+    _tree = outer;
+}
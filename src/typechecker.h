@@ -7,53 +7,78 @@
 #include "parser.h"
 #include "ast.h"
 #include "types.h"
+#include "overloads.h"
 #include "namescope.h"
 #include "binder.h"
+#include "diagnostics.h"
 
 namespace rvm {
-    class TypeChecker :
-        public rvm::ast::ModuleMemberVisitor,
-        public rvm::ast::TypeExpressionVisitor,
-        public rvm::ast::StatementVisitor {
+    class ThreadPool;
+    class QueryEngine;
+
+    class TypeChecker : public rvm::ast::Visitor<TypeChecker> {
 
         Binder* _binder;
         NameScope* _currentScope;
+        DiagnosticEngine* _diagnostics;
+        ThreadPool* _pool;
+        // Asked for the signatures of the Symbols bodies reference, when checking on demand.
+        QueryEngine* _queries;
+
+        friend class rvm::QueryEngine;
 
-        std::vector<std::unique_ptr<rvm::type::Type>> _types;
+        rvm::type::TypeContext _ownTypes;
+        rvm::type::TypeContext* _types;
+        rvm::type::OverloadCache _calls;
+        // Scratch for the argument types of a prototype or the value types of a call.
+        std::vector<rvm::type::Type*> _argumentTypes;
 
     public:
-        TypeChecker(Binder* binder) : _binder(binder), _currentScope(binder) {}
+        /// Errors throw a CompilerError, unless diagnostics is given: then they are reported there,
+        /// the expression gets the error type and checking goes on.
+        /// Types are interned in types, or in a TypeContext of the TypeChecker's own.
+        TypeChecker(Binder* binder, DiagnosticEngine* diagnostics = nullptr, rvm::type::TypeContext* types = nullptr) :
+            _binder(binder), _currentScope(binder), _diagnostics(diagnostics), _pool(nullptr), _queries(nullptr), _types(types != nullptr ? types : &_ownTypes) {}
+
+        /// Checks function bodies in parallel on pool, with the same types, errors and diagnostics as checking serially.
+        TypeChecker(Binder* binder, ThreadPool& pool, DiagnosticEngine* diagnostics = nullptr, rvm::type::TypeContext* types = nullptr) :
+            _binder(binder), _currentScope(binder), _diagnostics(diagnostics), _pool(&pool), _queries(nullptr), _types(types != nullptr ? types : &_ownTypes) {}
+
+        TypeChecker(const TypeChecker&) = delete;
+        TypeChecker& operator=(const TypeChecker&) = delete;
+
+        rvm::type::TypeContext& types() { return *_types; }
 
         /// Fully type check all members of the module.
-        void check(rvm::Parser* module) {
-            module->visit(this);
-        }
+        /// The signatures of all functions are added to their Symbols first, so calls resolve against
+        /// every overload whatever the order of the declarations. Then the members are checked,
+        /// with a pool their bodies are checked in parallel since they only read the signatures.
+        void check(rvm::Parser* module);
 
-        void on(rvm::ast::FunctionArgument* arg) {
+        void onFunctionArgument(rvm::ast::NodeId arg) {
             // Get the type of the type expression and move on the argument.
             // Normally vars and consts will either force type from type annotation or infer the type from assignment.
             // For function arguments the type can not be infered.
-            arg->typeAnnotation()->visit(this);
-            arg->setType(arg->typeAnnotation()->type());
+            visit(_tree->typeAnnotation(arg));
+            _tree->setType(arg, _tree->type(_tree->typeAnnotation(arg)));
         }
 
-        void on(rvm::ast::FunctionPrototype* proto) {
-            std::vector<rvm::type::Type*> argumentTypes;
-            for(auto& arg : proto->args()) {
-                on(arg.get());
-                argumentTypes.push_back(arg->type());
+        void onFunctionPrototype(rvm::ast::NodeId proto) {
+            // Identical prototypes share one SignatureType, the scratch vector is reused between them.
+            _argumentTypes.clear();
+            for(auto arg : _tree->args(proto)) {
+                onFunctionArgument(arg);
+                _argumentTypes.push_back(_tree->type(arg));
             }
 
-            proto->returnTypeAnnotation()->visit(this);
-            rvm::type::Type* returnType = proto->returnTypeAnnotation()->type();
+            visit(_tree->returnTypeAnnotation(proto));
+            rvm::type::Type* returnType = _tree->type(_tree->returnTypeAnnotation(proto));
 
-            auto type = std::make_unique<rvm::type::SignatureType>(returnType, std::move(argumentTypes));
-            proto->setType(type.get());
-            _types.push_back(std::move(type));
+            _tree->setType(proto, _types->signature(returnType, _argumentTypes));
         }
 
-        void on(rvm::ast::Function* f) override {
-            on(f->proto().get());
+        void onFunction(rvm::ast::NodeId f) {
+            onFunctionPrototype(_tree->proto(f));
 
             // TODO: Read the args, the return type, assign a type to the function declaration...
             // f->args()
@@ -61,117 +86,198 @@ namespace rvm {
 
             // TODO: Store the return type on stack to typecheck return expressions inside...
             // TODO: Push the args in name scope...
-            f->codeBlock()->visit(this);
+            // A deferred body with errors is noNode, they were reported when parsing it.
+            rvm::ast::NodeId block = _tree->codeBlock(f);
+            if (block != rvm::ast::noNode) visit(block);
         }
-        void on(rvm::ast::FunctionDeclaration* f) override {
+        void onFunctionDeclaration(rvm::ast::NodeId f) {
             // TODO: Read the args, the return type, assign a type to the function declaration...
         }
-        void on(rvm::ast::PrimitiveTypeExpression* t) override {
-            switch (t->type()) {
+        void onPrimitiveType(rvm::ast::NodeId t) {
+            switch (_tree->primitiveType(t)) {
                 case rvm::ast::PrimitiveType::Float:
-                    t->setType(rvm::type::getFloat());
+                    _tree->setType(t, rvm::type::getFloat());
                     return;
                 case rvm::ast::PrimitiveType::Int:
-                    t->setType(rvm::type::getInt());
+                    _tree->setType(t, rvm::type::getInt());
                     return;
                 case rvm::ast::PrimitiveType::Bool:
-                    t->setType(rvm::type::getBool());
+                    _tree->setType(t, rvm::type::getBool());
                     return;
                 case rvm::ast::PrimitiveType::String:
-                    t->setType(rvm::type::getString());
+                    _tree->setType(t, rvm::type::getString());
                     return;
             }
         }
-        void on(rvm::ast::CodeBlock* statement) override {
-            for(auto& statement : statement->statements())
-                statement->visit(this);
+        void onCodeBlock(rvm::ast::NodeId block) {
+            for(auto statement : _tree->statements(block))
+                visit(statement);
         }
-        void on(rvm::ast::ConstStatement* statement) override {
+        void onConstStatement(rvm::ast::NodeId statement) {
             // TODO: There should be a difference between type annotation and type resolved by the checker...
-            auto& typeExpression = statement->typeAnnotation();
-            if (typeExpression != nullptr)
-                typeExpression->visit(this);
+            auto typeExpression = _tree->typeAnnotation(statement);
+            if (typeExpression != rvm::ast::noNode)
+                visit(typeExpression);
 
             // Assignment for the const expressions is mandatory.
-            statement->value()->visit(this);
+            visit(_tree->value(statement));
 
             // TODO: Read the type annotation if any
             // TODO: Read the assignment expression and make sure it is assignable to the annotation, or infer type from it.
             // TODO: Push a const in the code block
         }
-        void on(rvm::ast::ReturnStatement* statement) override {
+        void onReturnStatement(rvm::ast::NodeId statement) {
             // TODO:
             assert(false);
         }
-        void on(rvm::ast::IdentifierExpression* expression) override {
-            Symbol* symbol = _currentScope->lookup(expression->name());
-            if (symbol == nullptr) throw CompilerError(ErrorCode::UnknownSymbolReference, expression->span());
-            expression->setType(symbol);
+        void onIdentifier(rvm::ast::NodeId expression) {
+            // On demand the name is asked for before it is looked up, so a body depends on names it fails to find too.
+            Atom name = _tree->name(expression);
+            if (_queries != nullptr) require(name);
+            Symbol* symbol = _currentScope->lookup(name);
+            if (symbol == nullptr || symbol->declarations().empty()) {
+                error(ErrorCode::UnknownSymbolReference, _tree->span(expression));
+                _tree->setType(expression, rvm::type::getError());
+                return;
+            }
+            _tree->setType(expression, symbol);
         }
-        void on(rvm::ast::ConstantValueExpression* expression) override {
-            auto token = expression->literal();
+        void onConstantValue(rvm::ast::NodeId expression) {
+            auto token = _tree->token(expression);
             switch(token.type()) {
-                case TokenType::Float: expression->setType(rvm::type::getFloat()); break;
-                case TokenType::Integer: expression->setType(rvm::type::getInt()); break;
-                case TokenType::SingleQuotesString: expression->setType(rvm::type::getString()); break;
-                case TokenType::DoubleQuotesString: expression->setType(rvm::type::getString()); break;
+                case TokenType::Float: _tree->setType(expression, rvm::type::getFloat()); break;
+                case TokenType::Integer: _tree->setType(expression, rvm::type::getInt()); break;
+                case TokenType::SingleQuotesString: _tree->setType(expression, rvm::type::getString()); break;
+                case TokenType::DoubleQuotesString: _tree->setType(expression, rvm::type::getString()); break;
                 default:
                     assert(false);
                     break;
             }
         }
-        void on(rvm::ast::MemberAccessExpression* expression) override {
+        void onMemberAccess(rvm::ast::NodeId expression) {
             // TODO:
             assert(false);
         }
-        void on(rvm::ast::InvocationExpression* expression) override {
-            expression->operand()->visit(this);
-            auto functionType = expression->operand()->type();
-
-            // TODO: This should force the Symbol to typecheck its functions and function declarations.
-            // TODO: This should probably include "declaration + function signature", otherwise the emitter won't know the function name and how to name mangle for the linker. Calling convention?
-            auto& overloads = functionType->callSignatures();
-            if (overloads.size() == 0)
-                assert(false); // TODO: CompilerError! Not callable...
-
-            // TODO: Make union types for the argument values to provide as context when resolving values.
-            std::vector<rvm::type::Type*> values;
-            for (auto& value : expression->values()) {
-                value->visit(this);
-                values.push_back(value->type());
-            }
-
-            // Now having the values and their types, resolve an overload... or throw.
-            for (auto& overload : overloads) {
-                // TODO: Create ReferenceType... expression->operand()->setType(overload);
-            }
-
-            // TODO: expression->setType(overload->returnType());
-            assert(false);
+        void onInvocation(rvm::ast::NodeId expression) {
+            walk(expression);
         }
-        void on(rvm::ast::ConditionalIfExpression* expression) override {
+        void onConditionalIf(rvm::ast::NodeId expression) {
             // TODO:
             assert(false);
         }
-        void on(rvm::ast::UnaryExpression* expression) override {
+        void onUnary(rvm::ast::NodeId expression) {
             // TODO:
             assert(false);
         }
-        void on(rvm::ast::BinaryExpression* expression) override {
-            // TODO:
-            switch(expression->op()) {
-                case rvm::ast::BinaryOperator::AddOperator: {
+        void onBinary(rvm::ast::NodeId expression) {
+            walk(expression);
+        }
+
+        /// Invocations and binary expressions are walked, their operands are checked before them in leave.
+        bool enter(rvm::ast::NodeId expression) {
+            switch (_tree->kind(expression)) {
+                case rvm::ast::Kind::Invocation:
+                    return true;
+                case rvm::ast::Kind::Binary:
                     // TODO: Maybe this should be for all + - * / operators, but what about = += -= etc?
-                    expression->lhs()->visit(this);
-                    expression->rhs()->visit(this);
-                    auto lType = expression->lhs()->type();
-                    auto rType = expression->rhs()->type();
+                    if (_tree->binaryOperator(expression) == rvm::ast::BinaryOperator::AddOperator) return true;
+                    error(ErrorCode::BinaryExpressionTypeError, _tree->span(expression));
+                    _tree->setType(expression, rvm::type::getError());
+                    return false;
+                default:
+                    visit(expression);
+                    return false;
+            }
+        }
+
+        void leave(rvm::ast::NodeId expression) {
+            if (_tree->kind(expression) == rvm::ast::Kind::Invocation) leaveInvocation(expression);
+            else leaveAddition(expression);
+        }
+
+    private:
+        /// A checker for the function bodies of module on another thread, with its own call cache and scratch.
+        TypeChecker(const TypeChecker& module, DiagnosticEngine* diagnostics) :
+            _binder(module._binder), _currentScope(module._binder), _diagnostics(diagnostics), _pool(nullptr), _queries(nullptr), _types(module._types) {}
 
-                    // TODO: float + float = float
-                    throw CompilerError(ErrorCode::BinaryExpressionTypeError, expression->span());
+        bool checkMembersInParallel(rvm::Parser* module);
+
+        /// Asks the QueryEngine for the call signatures of the Symbol named name.
+        void require(Atom name);
+
+        /// Types the prototype of a function or function declaration of tree and returns its signature.
+        rvm::type::SignatureType* signature(rvm::ast::Tree& tree, rvm::ast::NodeId member);
+
+        /// Checks the body of a function of tree, without its prototype.
+        void body(rvm::ast::Tree& tree, rvm::ast::NodeId function);
+
+        /// Types the prototype of a function or function declaration and adds its signature to the Symbol of its name.
+        void declare(rvm::ast::NodeId member) {
+            auto kind = _tree->kind(member);
+            if (kind != rvm::ast::Kind::Function && kind != rvm::ast::Kind::FunctionDeclaration) return;
+
+            auto proto = _tree->proto(member);
+            onFunctionPrototype(proto);
+            Symbol* symbol = _binder->lookup(_tree->name(member));
+            assert(symbol != nullptr);
+            symbol->addCallSignature(static_cast<rvm::type::SignatureType*>(_tree->type(proto)));
+        }
+
+        void leaveInvocation(rvm::ast::NodeId expression) {
+            auto functionType = _tree->type(_tree->operand(expression));
+
+            // The operand already reported its error.
+            if (functionType == rvm::type::getError()) {
+                _tree->setType(expression, rvm::type::getError());
+                return;
+            }
+
+            // TODO: This should probably include "declaration + function signature", otherwise the emitter won't know the function name and how to name mangle for the linker. Calling convention?
+            if (functionType->callSignatures().empty()) {
+                error(ErrorCode::NotCallable, _tree->span(_tree->operand(expression)));
+                _tree->setType(expression, rvm::type::getError());
+                return;
+            }
+
+            // TODO: Make union types for the argument values to provide as context when resolving values.
+            _argumentTypes.clear();
+            for (auto value : _tree->values(expression)) {
+                auto type = _tree->type(value);
+                if (type == rvm::type::getError()) {
+                    _tree->setType(expression, rvm::type::getError());
+                    return;
                 }
-                default: throw CompilerError(ErrorCode::BinaryExpressionTypeError, expression->span());
+                _argumentTypes.push_back(type);
+            }
+
+            // Types are unique, so the call resolves by the value types, and the same types resolve once per callee.
+            auto overload = _calls.resolve(functionType, _argumentTypes);
+            if (overload == nullptr) {
+                error(ErrorCode::NoMatchingOverload, _tree->span(expression));
+                _tree->setType(expression, rvm::type::getError());
+                return;
+            }
+
+            // TODO: Create ReferenceType... _tree->setType(_tree->operand(expression), overload);
+            _tree->setType(expression, overload->returnType());
+        }
+
+        void leaveAddition(rvm::ast::NodeId expression) {
+            auto lType = _tree->type(_tree->lhs(expression));
+            auto rType = _tree->type(_tree->rhs(expression));
+
+            // The operands already reported their errors.
+            if (lType != rvm::type::getError() && rType != rvm::type::getError()) {
+                // TODO: float + float = float
+                error(ErrorCode::BinaryExpressionTypeError, _tree->span(expression));
             }
+            _tree->setType(expression, rvm::type::getError());
+        }
+
+        /// Throws, or reports the error when checking with a DiagnosticEngine.
+        void error(ErrorCode code, SourceSpan span) {
+            if (_diagnostics == nullptr) throw CompilerError(code, span);
+            _diagnostics->report(code, span);
         }
     };
 };
@@ -1,13 +1,101 @@
+#include <cassert>
+#include <algorithm>
+#include <mutex>
+
 #include "types.h"
+#include "overloads.h"
 
+using namespace std;
+using namespace rvm;
 using namespace rvm::type;
 
 PrimitiveType primitiveInt = PrimitiveType(rvm::type::PrimitiveType::Int);
 PrimitiveType primitiveFloat = PrimitiveType(rvm::type::PrimitiveType::Float);
 PrimitiveType primitiveBool = PrimitiveType(rvm::type::PrimitiveType::Bool);
 PrimitiveType primitiveString = PrimitiveType(rvm::type::PrimitiveType::String);
+ErrorType errorType;
 
 PrimitiveType* rvm::type::getInt() { return &primitiveInt; }
 PrimitiveType* rvm::type::getFloat() { return &primitiveFloat; }
 PrimitiveType* rvm::type::getBool() { return &primitiveBool; }
 PrimitiveType* rvm::type::getString() { return &primitiveString; }
+ErrorType* rvm::type::getError() { return &errorType; }
+
+const OverloadSet& rvm::type::Type::callSignatures() const {
+    static const OverloadSet none;
+    return none;
+}
+
+namespace {
+    // Mixes the ids of a signature's parts, types are unique so equal signatures hash equal.
+    size_t hashSignature(Type* returnType, TypeList argumentTypes) {
+        unsigned long long hash = 0xCBF29CE484222325ULL ^ returnType->id();
+        for (auto argument : argumentTypes) hash = (hash ^ argument->id()) * 0x100000001B3ULL;
+        hash ^= argumentTypes.size();
+        hash *= 0x9E3779B97F4A7C15ULL;
+        return static_cast<size_t>(hash ^ (hash >> 32));
+    }
+
+    bool sameSignature(SignatureType* signature, Type* returnType, TypeList argumentTypes) {
+        return signature->returnType() == returnType && signature->argumentTypes().size() == argumentTypes.size()
+            && equal(argumentTypes.begin(), argumentTypes.end(), signature->argumentTypes().begin());
+    }
+}
+
+SignatureType* rvm::type::TypeContext::findSignature(Type* returnType, TypeList argumentTypes, size_t& slot) const {
+    if (_signatures.empty()) return nullptr;
+    size_t mask = _signatures.size() - 1;
+    for (slot = hashSignature(returnType, argumentTypes) & mask; _signatures[slot] != nullptr; slot = (slot + 1) & mask) {
+        if (sameSignature(_signatures[slot], returnType, argumentTypes)) return _signatures[slot];
+    }
+    return nullptr;
+}
+
+SignatureType* rvm::type::TypeContext::signature(Type* returnType, TypeList argumentTypes) {
+    size_t slot;
+    {
+        shared_lock<shared_mutex> lock(_mutex);
+        auto found = findSignature(returnType, argumentTypes, slot);
+        if (found != nullptr) return found;
+    }
+
+    unique_lock<shared_mutex> lock(_mutex);
+    // Kept at most half full, so probes stay short and always reach an empty slot.
+    if ((_signatureCount + 1) * 2 > _signatures.size()) growSignatures();
+    auto found = findSignature(returnType, argumentTypes, slot);
+    if (found != nullptr) return found;
+
+    Type** arguments = static_cast<Type**>(_arena.allocate(sizeof(Type*) * max<size_t>(argumentTypes.size(), 1), alignof(Type*)));
+    copy(argumentTypes.begin(), argumentTypes.end(), arguments);
+    auto id = static_cast<unsigned int>(firstId + _types.size());
+    static_assert(is_trivially_destructible<SignatureType>::value, "Types are freed with the Arena and never destroyed");
+    auto signature = new (_arena.allocate(sizeof(SignatureType), alignof(SignatureType))) SignatureType(id, returnType, TypeList(arguments, argumentTypes.size()));
+    _types.push_back(signature);
+    _signatures[slot] = signature;
+    _signatureCount++;
+    return signature;
+}
+
+void rvm::type::TypeContext::growSignatures() {
+    vector<SignatureType*> signatures(_signatures.empty() ? 16 : _signatures.size() * 2, nullptr);
+    size_t mask = signatures.size() - 1;
+    for (auto signature : _signatures) {
+        if (signature == nullptr) continue;
+        size_t slot = hashSignature(signature->returnType(), signature->argumentTypes()) & mask;
+        while (signatures[slot] != nullptr) slot = (slot + 1) & mask;
+        signatures[slot] = signature;
+    }
+    _signatures = move(signatures);
+}
+
+Type* rvm::type::TypeContext::type(unsigned int id) const {
+    switch (id) {
+        case 1: return getInt();
+        case 2: return getFloat();
+        case 3: return getBool();
+        case 4: return getString();
+        case 5: return getError();
+    }
+    shared_lock<shared_mutex> lock(_mutex);
+    return id >= firstId && id - firstId < _types.size() ? _types[id - firstId] : nullptr;
+}
@@ -2,17 +2,51 @@
 #define RVM_TYPES_H
 
 #include <vector>
+#include <cstddef>
+#include <shared_mutex>
+#include "arena.h"
 
 namespace rvm {
     namespace type {
 
         class SignatureType;
+        class OverloadSet;
+        class TypeContext;
 
+        /// Types are immutable and unique: the primitives are singletons and structural types are
+        /// interned by a TypeContext, so two types are equal exactly when they are the same object.
+        /// Interned types are numbered by a small id, 0 for types that are not interned such as Symbols.
         class Type {
-            std::vector<SignatureType*> _callSignatures;
+            unsigned int _id;
+
+            friend class TypeContext;
+
+        protected:
+            Type(unsigned int id) : _id(id) {}
+
+        public:
+            Type() : _id(0) {}
+            unsigned int id() const { return _id; }
+
+            /// The signatures a value of the type can be called with, none unless overridden.
+            virtual const OverloadSet& callSignatures() const;
+        };
+
+        /// A list of Types viewing an array that lives as long as its owner.
+        class TypeList {
+            Type* const* _data;
+            size_t _size;
+
         public:
-            Type() : _callSignatures() {}
-            virtual std::vector<SignatureType*>& callSignatures() { return _callSignatures; }
+            TypeList() : _data(nullptr), _size(0) {}
+            TypeList(Type* const* data, size_t size) : _data(data), _size(size) {}
+            TypeList(const std::vector<Type*>& types) : _data(types.data()), _size(types.size()) {}
+
+            size_t size() const { return _size; }
+            bool empty() const { return _size == 0; }
+            Type* operator[](size_t index) const { return _data[index]; }
+            Type* const* begin() const { return _data; }
+            Type* const* end() const { return _data + _size; }
         };
 
         class PrimitiveType : public Type {
@@ -26,25 +60,73 @@ namespace rvm {
         private:
             Type _type;
         public:
-            PrimitiveType(Type type) : _type(type) {}
-            Type type() { return _type; }
+            // Primitives take the ids 1 to 4.
+            PrimitiveType(Type type) : rvm::type::Type(static_cast<unsigned int>(type) + 1), _type(type) {}
+            Type type() const { return _type; }
         };
 
-        /// A function signature type.
+        /// A function signature type, created by TypeContext::signature.
         class SignatureType : public Type {
             Type* _returnType;
-            std::vector<Type*> _argumentTypes;
+            TypeList _argumentTypes;
+
+            friend class TypeContext;
+            SignatureType(unsigned int id, Type* returnType, TypeList argumentTypes) : Type(id), _returnType(returnType), _argumentTypes(argumentTypes) {}
+
         public:
-            SignatureType(Type* returnType, std::vector<Type*> argumentTypes) : _returnType(returnType), _argumentTypes(std::move(argumentTypes)) {}
-            Type* returnType() { return _returnType; }
-            std::vector<Type*> argumentTypes() { return _argumentTypes; }
+            Type* returnType() const { return _returnType; }
+            const TypeList& argumentTypes() const { return _argumentTypes; }
+        };
+
+        /// The type of expressions that failed to type check.
+        /// Expressions depending on it are not reported again, so one mistake gives one error.
+        class ErrorType : public Type {
+        public:
+            ErrorType() : Type(5) {}
         };
 
         PrimitiveType* getInt();
         PrimitiveType* getFloat();
         PrimitiveType* getBool();
         PrimitiveType* getString();
+        ErrorType* getError();
+
+        /// Interns the structural types of a compilation, each structure is created once in the
+        /// TypeContext's Arena and found again by hashing the ids of its parts, so interning a type
+        /// that exists compares integers and allocates nothing. Types live as long as the TypeContext.
+        ///
+        /// Each kind of structural type has its own open addressing table, new kinds add one next to signatures.
+        /// Passes on several threads intern concurrently, finding a type that exists shares the lock.
+        class TypeContext {
+            mutable std::shared_mutex _mutex;
+            Arena _arena;
+            // Interned types by id, from firstId on.
+            std::vector<Type*> _types;
+            // Open addressing table of signatures, nullptr for empty slots.
+            std::vector<SignatureType*> _signatures;
+            size_t _signatureCount;
+
+            void growSignatures();
+            SignatureType* findSignature(Type* returnType, TypeList argumentTypes, size_t& slot) const;
+
+        public:
+            /// The id of the first interned type, the ones before are the primitives and the error type.
+            static const unsigned int firstId = 6;
+
+            TypeContext() : _signatureCount(0) {}
+            TypeContext(const TypeContext&) = delete;
+            TypeContext& operator=(const TypeContext&) = delete;
+
+            /// The unique signature returning returnType for argumentTypes.
+            SignatureType* signature(Type* returnType, TypeList argumentTypes);
+
+            /// The type with id, primitives included, or nullptr when there is none.
+            Type* type(unsigned int id) const;
+
+            /// The number of interned types.
+            size_t size() const { std::shared_lock<std::shared_mutex> lock(_mutex); return _types.size(); }
+        };
     };
 };
 
-#endif
\ No newline at end of file
+#endif
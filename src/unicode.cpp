@@ -0,0 +1,27 @@
+#include <algorithm>
+
+#include "unicode.h"
+#include "unicodetables.h"
+
+using namespace std;
+using namespace rvm;
+using namespace rvm::unicode;
+
+namespace {
+    template<size_t size>
+    bool contains(const CodePointRange (&ranges)[size], char32_t c) {
+        // The first range ending at or after c.
+        auto range = lower_bound(ranges, ranges + size, c, [](const CodePointRange& range, char32_t c) { return range.last < c; });
+        return range != ranges + size && range->first <= c;
+    }
+}
+
+bool rvm::unicode::isXidStart(char32_t c) {
+    if (c < 0x80) return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    return contains(xidStartRanges, c);
+}
+
+bool rvm::unicode::isXidContinue(char32_t c) {
+    if (c < 0x80) return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+    return contains(xidContinueRanges, c);
+}
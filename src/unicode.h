@@ -0,0 +1,37 @@
+#ifndef RVM_UNICODE_H
+#define RVM_UNICODE_H
+
+#include "source.h"
+
+// Unicode support for the Lexer, which only comes here for characters outside ASCII.
+namespace rvm {
+    namespace unicode {
+        /// Decodes the UTF-8 sequence at p and sets next to the character after it.
+        /// The sequence must be valid, SourceBuffer validates its code up to invalidUtf8.
+        inline char32_t decode(const Char* p, const Char*& next) {
+            const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+            if (u[0] < 0x80) {
+                next = p + 1;
+                return u[0];
+            }
+            if (u[0] < 0xE0) {
+                next = p + 2;
+                return (char32_t(u[0] & 0x1F) << 6) | (u[1] & 0x3F);
+            }
+            if (u[0] < 0xF0) {
+                next = p + 3;
+                return (char32_t(u[0] & 0x0F) << 12) | (char32_t(u[1] & 0x3F) << 6) | (u[2] & 0x3F);
+            }
+            next = p + 4;
+            return (char32_t(u[0] & 0x07) << 18) | (char32_t(u[1] & 0x3F) << 12) | (char32_t(u[2] & 0x3F) << 6) | (u[3] & 0x3F);
+        }
+
+        /// Whether c can start an identifier, Unicode XID_Start.
+        bool isXidStart(char32_t c);
+
+        /// Whether c can continue an identifier, Unicode XID_Continue.
+        bool isXidContinue(char32_t c);
+    };
+};
+
+#endif